@@ -12,7 +12,8 @@ std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
 int maxnums = 2;
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow){
-    
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
     WNDCLASSEX wcex;
     wcex.cbSize = sizeof(WNDCLASSEX);
     wcex.style = CS_HREDRAW | CS_VREDRAW;
@@ -64,6 +65,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
+    CleanupRequests();
+    curl_global_cleanup();
     return (int)msg.wParam;
 }
 
@@ -2,6 +2,8 @@
 #include <curl/curl.h>
 
 std::pair<int, std::string> DoRequest(std::string, std::string);
+//frees the handle the downloads share, before curl_global_cleanup
+void CleanupRequests();
 int progress_func(void*, double, double, double, double);
 void UpdateProgress(std::string);
 double roundoff(double, unsigned char);
\ No newline at end of file
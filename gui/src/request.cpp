@@ -1,15 +1,24 @@
 #include <request.hpp>
 
+//one handle for every download of the session, reset between them so the
+//connection and DNS caches of the previous download can be reused
+static CURL* curl = NULL;
+
 std::pair<int, std::string> DoRequest(std::string url, std::string filename) {
-    CURL* curl;
     CURLcode Curlresult;
 
-    curl = curl_easy_init();
+    if (curl) {
+        curl_easy_reset(curl);
+    }
+    else {
+        curl = curl_easy_init();
+    }
 
     if (curl) {
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
         /* allow redirections */
         curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 64 * 1024L);
 
         curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
@@ -37,8 +46,6 @@ std::pair<int, std::string> DoRequest(std::string url, std::string filename) {
             return std::make_pair(1,"error while opening file");
             //std::cout << "error while opening file" << std::endl;
         }
-        curl_easy_cleanup(curl);
-        curl_global_cleanup();
     }
     else {
         return std::make_pair(1,"error initializing curl!");
@@ -47,6 +54,13 @@ std::pair<int, std::string> DoRequest(std::string url, std::string filename) {
 	return std::make_pair(0,"");
 }
 
+void CleanupRequests() {
+    if (curl) {
+        curl_easy_cleanup(curl);
+        curl = NULL;
+    }
+}
+
 int progress_func(void* ptr, double TotalToDownload, double NowDownloaded, double TotalToUpload, double NowUploaded){
     double percentage = NowDownloaded / TotalToDownload * 100;
     //percentage = roundoff(percentage, 2);
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include <stall.hpp>
+
+struct BatchOptions {
+    //file with one "url [output]" per line, plain or gzip compressed, "-" for stdin
+    std::string listFile = "";
+    //directory the outputs are written to
+    std::string outputDir = ".";
+    //levels of hash-prefix subdirectories (256 each) the outputs are spread over, 0 for none
+    int fanout = 0;
+    //number of concurrent transfers
+    int jobs = 8;
+    //event loop threads the transfers are spread over
+    int threads = 1;
+    //retries per job before it is reported as failed
+    int maxRetries = 3;
+    bool verbose = false;
+    //"lpt" probes sizes first and runs the largest jobs first, "fifo" keeps list order
+    std::string schedule = "lpt";
+    //files are only split into segments of at least this many bytes
+    curl_off_t minSegment = 1024 * 1024;
+    //jobs read ahead of the transfers, bounds memory for lists of any length
+    size_t lookahead = 10000;
+    //journal file that lets an interrupted batch skip its finished jobs when run again, "" for none
+    std::string journal = "";
+    //tar or WARC file every body is appended to instead of its own output file, "" for none
+    std::string pack = "";
+    //resolve the hosts of each window at once before its transfers start
+    bool dnsPrefetch = false;
+    //file the prefetched answers are kept in until their TTL runs out, "" for none
+    std::string dnsCache = "";
+    //nameserver the prefetch asks as "ip[:port]", "" for the first one of resolv.conf
+    std::string dnsServer = "";
+    //stalled transfers are aborted and retried like timeouts
+    StallOptions stall;
+};
+
+struct BatchJob {
+    std::string url = "";
+    std::string output = "";
+    std::string host = "";
+    int attempts = 0;
+    //earliest time (NowSeconds) the job may be dispatched again
+    double notBefore = 0;
+    //size and range support learned by the pre-flight probe, -1 if unknown
+    curl_off_t size = -1;
+    bool ranges = false;
+    //byte range of a segment of a larger file, -1 for the whole file
+    curl_off_t rangeStart = -1;
+    curl_off_t rangeEnd = -1;
+    //position of the job in its list, keys the journal
+    long long index = -1;
+    //continue a partial output left by an interrupted run
+    bool resume = false;
+};
+
+//downloads every job of the list file
+int RunBatch(BatchOptions);
+//downloads the given jobs, their output paths are used as they are
+int RunJobs(BatchOptions, std::vector<BatchJob>);
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <cstddef>
+#include <curl/curl.h>
+
+//fixed-size blocks for body data held in memory, shared by every transfer of
+//the process. The blocks handed out are charged against a budget; once it is
+//used up Acquire fails and the caller pauses its transfer until blocks are
+//released again
+class BufferPool {
+private:
+    std::mutex lock;
+    std::vector<char*> spare;
+    size_t budget;
+    size_t inUse;
+    size_t peak;
+public:
+    static constexpr size_t blockSize = 16 * 1024;
+    BufferPool();
+    ~BufferPool();
+    //bytes the blocks in use may add up to, 0 for no limit
+    void SetBudget(size_t);
+    size_t Budget();
+    //NULL when the budget is used up, unless forced past it
+    char* Acquire(bool = false);
+    void Release(char*);
+    //whether a block can be acquired within the budget
+    bool Available();
+    size_t InUse();
+    size_t Peak();
+};
+
+//the pool every body buffer of the process comes from
+BufferPool& Buffers();
+
+//a body kept in pool blocks
+class BufferChain {
+private:
+    std::vector<char*> blocks;
+    size_t size;
+public:
+    BufferChain();
+    BufferChain(BufferChain&&) noexcept;
+    BufferChain(const BufferChain&) = delete;
+    BufferChain& operator=(const BufferChain&) = delete;
+    ~BufferChain();
+    //appends all of the data or, when the pool has no blocks for it, nothing
+    bool Append(const char*, size_t, bool = false);
+    size_t Size() const;
+    size_t Blocks() const;
+    const char* Block(size_t) const;
+    size_t BlockLength(size_t) const;
+    //hands every block back to the pool
+    void Clear();
+};
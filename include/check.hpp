@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <curl/curl.h>
+
+struct CheckOptions {
+    //file with one url per line (further fields are ignored), or a single url
+    std::string listFile = "";
+    std::string url = "";
+    int connections = 64;
+    long timeout = 30;
+};
+
+struct CheckStats {
+    long long checked = 0;
+    long long broken = 0;
+    //urls whose HEAD was refused and that were checked with a one byte GET
+    long long fallbacks = 0;
+};
+
+//checks every url with HEAD requests (a ranged GET where HEAD is refused) and
+//prints "status size latency_ms url" per url, without writing any file
+bool RunCheck(CheckOptions, CheckStats&);
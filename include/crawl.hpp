@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <curl/curl.h>
+
+//fixed size Bloom filter, used to deduplicate the crawl frontier in a few bits per url
+class BloomFilter {
+private:
+    std::vector<uint64_t> bits;
+    uint64_t size;
+    int hashes;
+public:
+    //sized for the expected number of entries at about 1% false positives
+    BloomFilter(uint64_t);
+    //adds the key, returns false if it was (probably) there already
+    bool Insert(const std::string&);
+};
+
+//pulls href/src attribute values out of HTML fed to it in arbitrary chunks
+class LinkExtractor {
+private:
+    enum class State { Text, Tag, Name, AfterName, Value, QuotedValue };
+    State state;
+    char quote;
+    std::string element;
+    std::string name;
+    std::string value;
+    void EndValue();
+public:
+    std::vector<std::string> links;
+    //the href of the page's <base> element, empty without one
+    std::string base;
+    LinkExtractor();
+    void Feed(const char*, size_t);
+};
+
+struct CrawlOptions {
+    std::string outputDir = ".";
+    //link depth followed from the start page
+    int maxDepth = 5;
+    //concurrent transfers overall and per host
+    int connections = 16;
+    int hostConnections = 4;
+    //minimum time between two requests to the same host, in seconds
+    double hostDelay = 0;
+    //only urls below the start url's directory are followed
+    bool noParent = true;
+    //expected number of urls, sizes the Bloom filter
+    uint64_t expectedUrls = 1000000;
+    bool verbose = false;
+};
+
+struct CrawlStats {
+    long long fetched = 0;
+    long long failed = 0;
+    long long links = 0;
+    curl_off_t bytes = 0;
+};
+
+//mirrors the pages reachable from url into outputDir/host/path
+bool Crawl(std::string, CrawlOptions, CrawlStats&);
@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <curl/curl.h>
+
+struct LoopDone {
+    CURL* curl;
+    CURLcode result;
+};
+
+struct EventLoop;
+
+//runs the transfers of a batch. With one loop they are driven by a multi
+//handle in the calling thread; with more, every loop is a thread (pinned to
+//a core) with its own multi and share handle. Transfers are sharded over the
+//loops by a key (the host, so connections get reused), a loop with free
+//slots and nothing queued steals queued transfers from the busiest one. The
+//caller sets the handles up, hands them in and gets them back once finished
+class EventLoops {
+private:
+    std::vector<EventLoop*> loops;
+    //loop currently running each handle, for Resume
+    std::map<CURL*, EventLoop*> owner;
+    std::mutex lock;
+    std::condition_variable finished;
+    std::vector<LoopDone> done;
+    bool woken;
+    std::atomic<bool> stop;
+    void Run(EventLoop*);
+    void Take(EventLoop*, std::vector<CURL*>&);
+    void Drive(EventLoop*, std::vector<LoopDone>&, int);
+public:
+    //number of loops and how many transfers each runs at a time
+    EventLoops(int, int);
+    ~EventLoops();
+    void Add(CURL*, unsigned int);
+    //continues a transfer its write callback paused
+    void Resume(CURL*);
+    //waits up to the timeout (ms) for transfers to finish and appends them
+    void Wait(std::vector<LoopDone>&, int);
+    //ends the current Wait early, from a loop thread (a transfer paused)
+    void Wake();
+    int Loops() const;
+};
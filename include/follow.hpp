@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <curl/curl.h>
+
+struct FollowOptions {
+    //poll interval while the file keeps growing, in seconds
+    double minInterval = 1;
+    //the interval doubles on every poll without news, up to this
+    double maxInterval = 60;
+    bool verbose = false;
+};
+
+//keeps the local file in sync with a remote file that only grows: every poll
+//asks for the bytes past the local length with a conditional range request
+//and appends them. A truncated or replaced remote file is downloaded again
+bool FollowFile(std::string, std::string, FollowOptions);
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <curl/curl.h>
+
+struct FtpMirrorOptions {
+    std::string outputDir = ".";
+    //control connections kept open to the server, transfers run over all of them
+    int connections = 4;
+    //directory levels walked below the start directory
+    int maxDepth = 32;
+    //attempts per listing or file before it counts as failed
+    int maxAttempts = 3;
+    bool verbose = false;
+};
+
+struct FtpMirrorStats {
+    long long dirs = 0;
+    long long files = 0;
+    long long skipped = 0;
+    long long failed = 0;
+    curl_off_t bytes = 0;
+};
+
+//mirrors the tree below an ftp:// directory url into outputDir/host/path.
+//Directories are listed with MLSD (NLST when the server lacks it), files whose
+//local copy has the remote size and time are skipped
+bool MirrorFtp(std::string, FtpMirrorOptions, FtpMirrorStats&);
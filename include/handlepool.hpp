@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <curl/curl.h>
+
+//easy handles kept for reuse, so a batch of small files doesn't pay for
+//creating and destroying one per transfer. A released handle is reset to
+//default options and gets the receive buffer size and the TLS session cache
+//again when handed out
+class HandlePool {
+private:
+    std::mutex lock;
+    std::vector<CURL*> idle;
+    long bufferSize;
+    size_t maxIdle;
+    long long created;
+    long long reused;
+public:
+    HandlePool();
+    ~HandlePool();
+    //receive buffer (CURLOPT_BUFFERSIZE) of the handles handed out, 0 for curl's default
+    void SetBufferSize(long);
+    //an idle handle, or a new one when there is none
+    CURL* Acquire();
+    //takes back a handle that isn't attached to a multi handle anymore
+    void Release(CURL*);
+    //cleans up every idle handle
+    void Clear();
+    long long Created();
+    long long Reused();
+};
+
+//the pool every transfer of the process takes its handles from
+HandlePool& Handles();
+
+//curl_global_init for the lifetime of the object, one per process (in main).
+//The pooled handles are cleaned up and the TLS sessions saved before curl_global_cleanup
+class CurlGlobal {
+public:
+    CurlGlobal();
+    ~CurlGlobal();
+};
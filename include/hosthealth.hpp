@@ -0,0 +1,50 @@
+#pragma once
+#include <map>
+#include <string>
+#include <random>
+
+enum class BreakerState { Closed, Open, HalfOpen };
+
+//health state kept for every origin of a batch
+struct HostHealth {
+    int consecutiveFailures = 0;
+    int timeouts = 0;
+    int failures = 0;
+    int successes = 0;
+    //moving average of the time to first byte, in seconds
+    double avgLatency = 0;
+    BreakerState state = BreakerState::Closed;
+    //when an open breaker lets the next probe through
+    double nextProbe = 0;
+    //trips since the host last recovered, drives the probe interval
+    int trips = 0;
+    //trips over the whole batch, for the report
+    int totalTrips = 0;
+    bool probeInFlight = false;
+};
+
+class HealthTracker {
+private:
+    std::map<std::string, HostHealth> hosts;
+    std::mt19937 rng;
+    int failureThreshold;
+    double probeInterval;
+    double maxProbeInterval;
+    void Trip(HostHealth&, double);
+public:
+    HealthTracker(int = 5, double = 5.0, double = 120.0);
+    //true if a job for this host may take a transfer slot now.
+    //For a half-open host this claims the single probe slot
+    bool CanDispatch(std::string, double);
+    void OnSuccess(std::string, double);
+    void OnFailure(std::string, bool, double);
+    bool IsOpen(std::string);
+    //earliest time a parked host may be probed again
+    double NextProbe(std::string);
+    //gives the probe slot back when the probe never reached the network, the
+    //host stays open and may be probed again from now on
+    void CancelProbe(std::string, double);
+    //jittered exponential backoff ("full jitter") for the given attempt
+    double Backoff(int, double = 0.5, double = 60.0);
+    const std::map<std::string, HostHealth>& Hosts();
+};
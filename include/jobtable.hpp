@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <curl/curl.h>
+#include <batch.hpp>
+
+//interns host names to small ids, so per-host state can be kept in arrays
+class HostTable {
+private:
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> names;
+public:
+    uint32_t Intern(const std::string&);
+    const std::string& Name(uint32_t) const;
+    size_t Size() const;
+};
+
+enum class JobState : uint8_t { Free, Ready, Delayed, Parked, Running };
+
+//batch jobs stored column by column: urls and output paths live in one
+//string arena, hosts are interned ids and the small fields are packed.
+//Rows are addressed by index and reused once released
+class JobTable {
+private:
+    std::vector<char> pool;
+    //bytes of the arena owned by released rows
+    size_t garbage;
+    std::vector<uint32_t> urls;
+    std::vector<uint32_t> outputs;
+    std::vector<uint32_t> hostIds;
+    std::vector<uint32_t> indexes;
+    //JobState in the low bits, then the resume and range support flags
+    std::vector<uint8_t> flags;
+    std::vector<uint8_t> attemptCounts;
+    std::vector<curl_off_t> sizes;
+    std::vector<curl_off_t> rangeStarts;
+    std::vector<curl_off_t> rangeEnds;
+    std::vector<double> notBefores;
+    std::vector<uint32_t> freeRows;
+    uint32_t Store(const std::string&);
+    void Compact();
+public:
+    HostTable hosts;
+    JobTable();
+    uint32_t Add(const BatchJob&);
+    void Release(uint32_t);
+    //the arena may move on Release, don't keep these pointers
+    const char* Url(uint32_t) const;
+    const char* Output(uint32_t) const;
+    uint32_t Host(uint32_t) const;
+    uint32_t Index(uint32_t) const;
+    JobState State(uint32_t) const;
+    void SetState(uint32_t, JobState);
+    bool Ranges(uint32_t) const;
+    bool Resume(uint32_t) const;
+    void SetResume(uint32_t, bool);
+    //counts a failed attempt, returns the attempts so far
+    int AddAttempt(uint32_t);
+    curl_off_t Size(uint32_t) const;
+    curl_off_t RangeStart(uint32_t) const;
+    curl_off_t RangeEnd(uint32_t) const;
+    double NotBefore(uint32_t) const;
+    void SetNotBefore(uint32_t, double);
+    size_t Live() const;
+    //heap bytes held by the columns and the arena
+    size_t MemoryBytes() const;
+};
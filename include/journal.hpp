@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+//append-only log of batch job state, so an interrupted batch can be run
+//again without redoing finished jobs. Jobs are identified by their position
+//in the list plus a hash of url and output, which catches edited lists.
+//Records are checksummed (crc32) and fsynced in groups; a torn or corrupt
+//tail left by a crash is cut off when the journal is opened
+class Journal {
+private:
+    FILE* file;
+    std::string path;
+    //pending records, written and synced together
+    std::string buffer;
+    double lastCommit;
+    //per list position: job key and the last state recorded for it
+    std::vector<uint32_t> keys;
+    std::vector<uint8_t> states;
+    long long records;
+    long long live;
+    long long replayed;
+    void Record(uint8_t, uint32_t, uint32_t);
+    void Apply(uint8_t, uint32_t, uint32_t);
+    bool Compact();
+public:
+    Journal();
+    ~Journal();
+    bool Open(std::string);
+    bool IsDone(uint32_t, uint32_t) const;
+    //the job was dispatched before but never finished, its output may be partial
+    bool WasStarted(uint32_t, uint32_t) const;
+    void Started(uint32_t, uint32_t);
+    void Finished(uint32_t, uint32_t);
+    //writes and fsyncs the pending records once the group interval has passed.
+    //false when that failed: the journal stops recording, what it holds stays valid
+    bool Commit(double, bool = false);
+    //records read back when the journal was opened
+    long long Replayed() const;
+    static uint32_t KeyOf(const char*, const char*);
+};
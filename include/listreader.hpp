@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+//reads a list file line by line through a fixed size buffer, so a list of
+//any length takes the same memory. Gzip compressed lists are read as they are
+class ListReader {
+private:
+    FILE* file;
+#ifdef HAVE_ZLIB
+    gzFile gz;
+#endif
+    std::vector<char> buffer;
+    size_t pos;
+    size_t end;
+    bool eof;
+    long long lines;
+    bool Fill();
+public:
+    ListReader();
+    ~ListReader();
+    //opens the list, "-" reads stdin
+    bool Open(std::string);
+    //next line without its line break, false at the end of the list
+    bool NextLine(std::string&);
+    long long Lines();
+};
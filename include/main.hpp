@@ -2,7 +2,30 @@
 #include <cmath>
 #include <curl/curl.h>
 #include <Argsparser.hpp>
+#ifndef __linux__
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include <batch.hpp>
+#include <stall.hpp>
+#include <segmented.hpp>
+#include <ranges.hpp>
+#include <zipmember.hpp>
+#include <playlist.hpp>
+#include <follow.hpp>
+#include <crawl.hpp>
+#include <ftpmirror.hpp>
+#include <sync.hpp>
+#include <check.hpp>
+#include <util.hpp>
+#include <bufferpool.hpp>
+#include <handlepool.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <splicefetch.hpp>
+#include <proxycache.hpp>
 
+void PrintOptionalParams();
 void HideCursor();
 void ShowCursor();
 int progress_func(void*, double, double, double, double);
\ No newline at end of file
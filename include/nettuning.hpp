@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <curl/curl.h>
+
+//socket policy of a kind of network. The receive buffer is sized to twice
+//the bandwidth-delay product of the host, from its measured round trip time
+//and throughput (the assumed link rate until the transfers say otherwise)
+struct NetProfile {
+    std::string name = "";
+    //assumed round trip time (s) and link rate (bytes/s) before anything is measured
+    double rtt = 0;
+    double rate = 0;
+    //bounds of the receive buffer
+    int minBuffer = 0;
+    int maxBuffer = 0;
+    bool fastOpen = false;
+    bool noDelay = true;
+    //keepalive probes after this many idle seconds, then every interval, 0 for none
+    long keepIdle = 0;
+    long keepInterval = 0;
+};
+
+//"lan", "wan" or "satellite", false for an unknown name
+bool ParseNetProfile(std::string, NetProfile&);
+
+struct HostPath {
+    //smoothed round trip time (s) and best throughput (bytes/s) seen, 0 until measured
+    double rtt = 0;
+    double rate = 0;
+    //receive buffer the last connection got, 0 if left to the kernel
+    int buffer = 0;
+};
+
+//applies the profile to every handle and learns the path to each host from
+//the transfers that finished. The kernel's receive buffer autotuning is only
+//overridden when the buffer a path needs is beyond what it grows to
+class NetTuner {
+private:
+    std::mutex lock;
+    NetProfile profile;
+    bool active;
+    std::map<std::string, HostPath> hosts;
+    //largest buffer autotuning reaches, and the most SO_RCVBUF is granted
+    int autotuneMax;
+    int grantMax;
+    static int SocketOptions(void*, curl_socket_t, curlsocktype);
+    void SizeReceiveBuffer(curl_socket_t, const std::string&);
+public:
+    NetTuner();
+    void SetProfile(const NetProfile&);
+    bool Active();
+    std::string Name();
+    //sets the socket policy of the profile on the handle
+    void Apply(CURL*);
+    //the same for a socket to the host opened without curl, before it connects
+    void Apply(curl_socket_t, const std::string&);
+    //takes the round trip and throughput of a finished transfer into account
+    void Record(CURL*);
+    //receive buffer for a new connection to the host, 0 to leave it to the kernel
+    int ReceiveBuffer(const std::string&);
+    std::map<std::string, HostPath> Hosts();
+};
+
+//the tuner of the process
+NetTuner& Network();
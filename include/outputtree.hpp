@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstdio>
+
+//creates batch outputs below their directories. Directories are opened once
+//and kept as fds (up to a limit, least recently used ones are closed), files
+//are created relative to them with openat instead of walking the whole path
+//again. An output is written to "<name>.part" and renamed in place once it is
+//complete, so a file under its final name is never partial
+class OutputTree {
+private:
+    size_t maxFds;
+    //open directories by path, most recently used first
+    std::list<std::string> recent;
+    std::unordered_map<std::string, std::pair<int, std::list<std::string>::iterator>> fds;
+    int Dir(const std::string&, bool);
+public:
+    OutputTree(size_t = 512);
+    ~OutputTree();
+    //creates the directories of the outputs, all at once and in path order
+    void Prepare(const std::vector<std::string>&);
+    //opens the temporary file of an output with an fopen mode
+    FILE* Open(const std::string&, const char*);
+    //moves a complete output in place
+    bool Publish(const std::string&);
+    //removes the temporary file of a failed output
+    void Discard(const std::string&);
+    static std::string TempPath(const std::string&);
+};
+
+//puts a file name below levels of hash-prefix subdirectories ("3f/a0/name"),
+//so no directory ends up with more than a few thousand entries
+std::string FanoutPath(std::string, int);
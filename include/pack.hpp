@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <random>
+#include <cstdio>
+#include <curl/curl.h>
+#include <bufferpool.hpp>
+
+enum class PackFormat { Tar, Warc };
+
+//appends downloaded bodies as records of one tar or WARC file, through a
+//single buffered sequential writer. A sidecar index (pack file + ".idx")
+//gets an "offset length name" line per record, the offset and length of the
+//body inside the pack, for random access without scanning it
+class PackWriter {
+private:
+    FILE* file;
+    FILE* index;
+    PackFormat format;
+    curl_off_t offset;
+    long long records;
+    std::mt19937_64 rng;
+    bool Write(const void*, size_t);
+    bool WriteBody(const BufferChain&);
+    bool TarHeader(std::string, char, curl_off_t);
+public:
+    PackWriter();
+    ~PackWriter();
+    //the format follows the extension, .warc or tar otherwise. With append, a
+    //pack left by an interrupted run is cut back to its last indexed record
+    //and continued
+    bool Open(std::string, bool);
+    bool Add(std::string, std::string, std::string, const BufferChain&);
+    void Flush();
+    //writes the end of archive marker
+    void Close();
+    long long Records() const;
+};
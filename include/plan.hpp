@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <functional>
+#include <batch.hpp>
+
+class Resolver;
+
+//sends a HEAD request for every job, concurrently over reused connections,
+//and fills in size and range support. The resolver's answers are used if given.
+//drive, if given, is called between rounds with a timeout (ms) to keep other
+//transfers of the thread going while the probes run
+void ProbeJobs(std::vector<BatchJob>&, int, Resolver* = NULL, std::function<void(int)> = nullptr);
+//longest-processing-time-first plan: jobs sorted by size, files bigger than
+//one slot's fair share split into range segments
+std::deque<BatchJob> PlanLpt(std::vector<BatchJob>&, int, curl_off_t);
+//bytes carried by the busiest slot when the queue is dispatched greedily in order
+curl_off_t PlannedMakespan(const std::deque<BatchJob>&, int);
+//creates the output of a segmented job at its final size
+bool PreallocateOutput(std::string, curl_off_t);
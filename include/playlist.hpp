@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <curl/curl.h>
+
+struct MediaSegment {
+    std::string url = "";
+    //byte range inside url, -1 for the whole resource
+    curl_off_t rangeStart = -1;
+    curl_off_t rangeEnd = -1;
+    //media sequence number, orders segments across live playlist reloads
+    long long sequence = 0;
+};
+
+struct MediaPlaylist {
+    std::vector<MediaSegment> segments;
+    //initialization segment (EXT-X-MAP / DASH Initialization), empty url if none
+    MediaSegment init;
+    //no more segments will be added (EXT-X-ENDLIST or a static MPD)
+    bool ended = true;
+    double targetDuration = 10;
+    //the url the media playlist was finally loaded from
+    std::string url = "";
+};
+
+struct PlaylistOptions {
+    //concurrent segment downloads
+    int connections = 8;
+    //segments fetched or held ahead of the one being written
+    int window = 32;
+    //live playlist reloads without new segments before giving up
+    int maxIdleReloads = 10;
+    bool verbose = false;
+};
+
+struct PlaylistStats {
+    long long segments = 0;
+    curl_off_t bytes = 0;
+    int reloads = 0;
+};
+
+//parses an m3u8 playlist. For a master playlist only variantUrl is set (the
+//variant with the highest bandwidth)
+bool ParseM3u8(std::string, std::string, MediaPlaylist&, std::string&);
+//parses the highest bandwidth representation of a static MPD
+bool ParseMpd(std::string, std::string, MediaPlaylist&);
+//downloads every segment of the HLS or DASH manifest at url into out, in
+//playlist order, following a live playlist until it ends
+bool DownloadPlaylist(std::string, FILE*, PlaylistOptions, PlaylistStats&);
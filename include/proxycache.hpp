@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <stall.hpp>
+
+struct ProxyOptions {
+    //port listened on, on the loopback interface
+    int port = 0;
+    //bodies and heads of the cached responses
+    std::string cacheDir = "";
+    //prints a line per request
+    bool verbose = false;
+    StallOptions stall;
+};
+
+//runs an HTTP forward proxy for the local tools. GET and HEAD of http:// urls
+//are fetched with curl into the cache directory and served from disk with
+//sendfile(); a miss that is already being fetched waits for that fetch
+//instead of starting another. Responses are kept as their Cache-Control
+//(max-age, s-maxage, no-store, private, no-cache) or Expires allow, stale
+//ones are revalidated with their ETag / Last-Modified. Requests with
+//credentials or no-store pass through uncached, CONNECT is tunnelled.
+//Only returns if the port can't be listened on (or on windows)
+bool RunProxyCache(ProxyOptions);
+
+//the cache directory of the user, proxy in UserCachePath
+std::string DefaultProxyCache();
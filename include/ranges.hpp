@@ -0,0 +1,65 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <curl/curl.h>
+#include <bufferpool.hpp>
+
+typedef std::pair<curl_off_t, curl_off_t> ByteRange;
+
+//parses "0-4095,1048576-2097151", sorted with overlapping ranges merged.
+//Returns false on a malformed list
+bool ParseRanges(std::string, std::vector<ByteRange>&);
+
+//where the fetched ranges go: a sparse file with every range at its offset, or a
+//stream of records made of a 16 byte header (big-endian offset and length) and the data
+class RangeOutput {
+private:
+    FILE* out;
+    bool stream;
+    std::map<curl_off_t, BufferChain> parts;
+public:
+    //set when a write failed only because the buffer pool is used up
+    bool blocked;
+    RangeOutput(FILE*, bool);
+    //stream mode holds each part in pool blocks until it is complete; unless
+    //forced that takes nothing once the pool is used up, the transfer pauses
+    bool Write(curl_off_t, curl_off_t, const char*, size_t, bool = false);
+    bool EndPart(curl_off_t);
+    //drops what was held of a part that broke off, it is fetched again from its start
+    void DropPart(curl_off_t);
+    //drops every part that never ended
+    void DropIncomplete();
+};
+
+//incremental parser of a multipart/byteranges body
+class MultipartParser {
+private:
+    enum class State { Preamble, Headers, Body, Done };
+    State state;
+    std::string delimiter;
+    std::string pending;
+    curl_off_t partStart;
+    curl_off_t partOffset;
+    RangeOutput* output;
+    bool BodyPart();
+public:
+    std::vector<ByteRange> received;
+    bool error;
+    MultipartParser(std::string, RangeOutput*);
+    void Feed(const char*, size_t);
+    bool Finished();
+};
+
+struct RangeStats {
+    int requests = 0;
+    bool multipart = false;
+    //the server ignored Range, the ranges were cut out of the whole file
+    bool wholeBody = false;
+};
+
+//fetches only the given ranges of url, merged into one multipart request when the
+//server supports it, otherwise as concurrent single-range requests. A server
+//without range support has them cut out of the one full response
+bool DownloadRanges(std::string, std::vector<ByteRange>, RangeOutput&, int, RangeStats&);
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <ctime>
+#include <curl/curl.h>
+
+struct ResolvedHost {
+    std::vector<std::string> addresses;
+    //wall clock time the answer stops being valid
+    time_t expires = 0;
+};
+
+//resolves the hosts of a batch ahead of its transfers: every host of a
+//window is queried at once (A and AAAA over udp, to the first nameserver of
+//resolv.conf or the given one) and the answers are handed to curl with
+//CURLOPT_RESOLVE, so transfers don't wait for DNS one by one. Answers are
+//kept for their TTL in a cache file, a later run starts with the ones still
+//valid. Hosts without an answer are left to curl's own resolver
+class Resolver {
+private:
+    std::string cacheFile;
+    //nameserver as "ip", "ip:port" or "[ipv6]:port"
+    std::string server;
+    std::map<std::string, ResolvedHost> hosts;
+    //names of the hosts file, never prefetched
+    std::set<std::string> local;
+    //CURLOPT_RESOLVE lists by "host:port", and the replaced ones, alive until the resolver goes away
+    std::map<std::string, curl_slist*> lists;
+    std::vector<curl_slist*> retired;
+    long long queries;
+    long long cached;
+    bool dirty;
+    void Query(const std::vector<std::string>&);
+public:
+    Resolver();
+    ~Resolver();
+    //reads the answers of the cache file ("" for none) that haven't expired
+    //and the nameserver to ask ("" for the system's)
+    bool Open(std::string, std::string);
+    //resolves the hosts without a valid answer, concurrently
+    void Prefetch(const std::vector<std::string>&);
+    //makes the handle connect to the prefetched addresses of the host, if any
+    void Apply(CURL*, const std::string&, long);
+    //writes the answers still valid back to the cache file
+    bool Save();
+    //dns queries sent and hosts read from the cache file
+    long long Queries() const;
+    long long Cached() const;
+};
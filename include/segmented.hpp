@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <curl/curl.h>
+
+struct SegmentOptions {
+    //concurrent range requests
+    int connections = 4;
+    //bytes fetched by one range request
+    curl_off_t chunkSize = 1024 * 1024;
+    //cap on chunks buffered ahead of the read head in ordered mode
+    curl_off_t memoryCap = 64 * 1024 * 1024;
+    //attempts per chunk before the download fails
+    int maxAttempts = 5;
+};
+
+enum class SegmentResult { Ok, Failed, Unsupported };
+
+//downloads url over several connections with range requests. In ordered mode the
+//bytes are written to out strictly in order (out may be a pipe), otherwise every
+//chunk is written at its own offset. Returns Unsupported when the server has no
+//range support or size, so the caller can fall back to a single connection
+SegmentResult DownloadSegmented(std::string, FILE*, bool, SegmentOptions);
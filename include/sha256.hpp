@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//incremental SHA-256 (FIPS 180-4)
+class Sha256 {
+private:
+    uint32_t state[8];
+    unsigned char block[64];
+    size_t blockLen;
+    uint64_t length;
+    void Transform(const unsigned char*);
+public:
+    Sha256();
+    void Update(const void*, size_t);
+    //lowercase hex digest, the object can't be updated afterwards
+    std::string Final();
+};
+
+//digest of a whole file (memory mapped where available), false if it can't be read
+bool Sha256File(std::string, std::string&);
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <curl/curl.h>
+
+struct SpliceStats {
+    //body bytes written, and the part of them that never left the kernel
+    curl_off_t bytes = 0;
+    curl_off_t spliced = 0;
+    double seconds = 0;
+};
+
+enum class SpliceResult { Ok, Failed, Unsupported };
+
+//downloads a plain http:// url into the file with a minimal HTTP/1.1 GET of
+//its own: once the headers are read the body goes from the socket to the
+//file through a pipe with splice(), without being copied to user space.
+//Anything but a 200 with an identity body (redirects, chunked encoding,
+//errors, userinfo in the url), a proxy from the environment that curl would
+//use for the url, or a platform without splice returns Unsupported before writing anything, so the caller can use curl instead
+SpliceResult DownloadSpliced(std::string, FILE*, SpliceStats&);
@@ -0,0 +1,45 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <curl/curl.h>
+
+struct StallOptions {
+    //throughput floor in bytes per second
+    long minSpeed = 1024;
+    //length of the sliding window the floor is checked over, in seconds
+    double window = 30;
+    //how many times a stalled transfer is reconnected before giving up
+    int maxReconnects = 5;
+};
+
+//flags a transfer whose throughput over the last window fell below the floor
+class StallDetector {
+private:
+    StallOptions opts;
+    std::deque<std::pair<double, curl_off_t>> samples;
+    double started;
+    double stalledTime;
+public:
+    StallDetector(StallOptions);
+    //forget the samples of the previous connection
+    void Reset(double);
+    //feeds the total bytes received so far, returns true once stalled
+    bool Update(double, curl_off_t);
+    //time spent below the floor, in seconds
+    double StalledTime();
+};
+
+struct ResumeStats {
+    int reconnects = 0;
+    double stalledTime = 0;
+};
+
+typedef int (*MeterFunc)(void*, double, double, double, double);
+
+//runs the transfer into file (opened from the output path), reconnecting and
+//resuming from the last written offset whenever it stalls. Every reconnect goes
+//to the next resolved address of the host
+CURLcode PerformWithResume(CURL*, FILE*&, std::string, std::string, StallOptions, ResumeStats&, MeterFunc);
+//xferinfo callback aborting the transfer when the StallDetector passed as clientp stalls
+int StallXferInfo(void*, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
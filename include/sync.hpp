@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <batch.hpp>
+
+struct SyncOptions {
+    //file with one "url size sha256 [path]" per line
+    std::string manifest = "";
+    //threads hashing local files, 0 for one per core
+    int hashThreads = 0;
+    //remove files below the output directory that the manifest doesn't list
+    bool deleteStale = false;
+    //outputDir, concurrency and retries of the downloads
+    BatchOptions batch;
+};
+
+struct SyncStats {
+    long long entries = 0;
+    long long upToDate = 0;
+    long long hashed = 0;
+    long long downloaded = 0;
+    long long failed = 0;
+    long long deleted = 0;
+};
+
+//makes the output directory match the manifest: local files with the listed
+//size and digest are kept, the others are downloaded and verified
+bool RunSync(SyncOptions, SyncStats&);
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <ctime>
+#include <curl/curl.h>
+
+struct StoredSession {
+    //serialized session (DER) and the time its ticket runs out
+    std::string data;
+    time_t expires = 0;
+};
+
+//TLS sessions of every transfer of the process, in a share handle the
+//handles are attached to. Built with OpenSSL (HAVE_OPENSSL) they are also
+//kept in a per-user cache file: loaded at startup, offered to the hosts they
+//came from, and merged back into the file at exit under a lock file so
+//processes running at the same time don't lose each other's sessions. A
+//later run against the same hosts then resumes instead of doing full
+//handshakes. Without it the sessions only live as long as the process
+class TlsSessions {
+private:
+    CURLSH* share;
+    std::mutex locks[CURL_LOCK_DATA_LAST];
+    std::string file;
+    //sessions for the next connections, by "host:port"
+    std::mutex storeLock;
+    std::map<std::string, std::vector<StoredSession>> stored;
+    //data of the sessions read from the file, they are used up or stored again
+    std::set<std::string> imported;
+    bool dirty;
+    long long loaded;
+    long long saved;
+    static void Lock(CURL*, curl_lock_data, curl_lock_access, void*);
+    static void Unlock(CURL*, curl_lock_data, void*);
+public:
+    TlsSessions();
+    ~TlsSessions();
+    //creates the share and reads the sessions of the file that haven't
+    //expired, "" keeps them in the process only. False if they can't be
+    //persisted in this build
+    bool Open(std::string);
+    //shares the sessions with the handle and counts its handshakes
+    void Attach(CURL*);
+    bool Active() const;
+    //called from the tls backend: a stored session for the "host:port", which is
+    //used up by it, and a new session the server handed out
+    bool Take(const std::string&, std::string&);
+    void Keep(const std::string&, const std::string&, time_t);
+    //merges the sessions into the file and releases the share, after every
+    //handle attached to it is gone
+    void Close();
+    long long Loaded() const;
+    long long Saved() const;
+    //handshakes that resumed a session and ones that didn't, -1 when the tls
+    //backend can't tell
+    long long Resumed() const;
+    long long Full() const;
+};
+
+//the session cache of the process
+TlsSessions& Sessions();
+//the cache file of the user, tls-sessions in UserCachePath
+std::string DefaultTlsCache();
@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <ctime>
+#include <curl/curl.h>
+
+//monotonic clock in seconds
+double NowSeconds();
+//hostname part of a url ("" if it can't be parsed)
+std::string HostOf(std::string);
+//port of a url, the scheme default if it has none
+long PortOf(std::string);
+//every address the host resolves to, as numeric strings
+std::vector<std::string> ResolveAddresses(std::string);
+//last path component of a url, used as default output name
+std::string FileNameOf(std::string);
+//64-bit safe fseek/ftell
+int SeekFile(FILE*, curl_off_t);
+curl_off_t TellFile(FILE*);
+//joins a directory and a file name
+std::string JoinPath(std::string, std::string);
+//resolves a possibly relative reference against a base url
+std::string ResolveUrl(std::string, std::string);
+//downloads a (small) document into memory, returns false on failure or HTTP error
+bool FetchText(CURL*, std::string, std::string&);
+//creates every missing directory leading up to the file path
+bool MakeParentDirs(std::string);
+//size and modification time of a local file, false if it doesn't exist
+bool StatFile(std::string, curl_off_t&, time_t&);
+//cuts a local file down to the given length
+bool TruncateFile(std::string, curl_off_t);
+//sets the modification time of a local file
+bool SetFileTime(std::string, time_t);
+//appends every regular file below the directory (recursively) to the list
+void ListFiles(std::string, std::vector<std::string>&);
+//a file or directory of the user's cache: $XDG_CACHE_HOME/download/name (~/.cache
+//if unset), %LOCALAPPDATA%\download\name on windows, "" without a home
+std::string UserCachePath(std::string);
+//peak resident memory of the process so far, in KiB
+long PeakMemoryKb();
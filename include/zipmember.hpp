@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <curl/curl.h>
+
+struct ZipMemberStats {
+    //bytes fetched for the archive's directory structures
+    curl_off_t metadataBytes = 0;
+    curl_off_t compressedSize = 0;
+    curl_off_t uncompressedSize = 0;
+    curl_off_t archiveSize = 0;
+    int requests = 0;
+};
+
+//extracts one member of a remote ZIP archive into out, fetching only the end of
+//central directory, the central directory and the member's own bytes with range
+//requests. Supports ZIP64, stored and deflated members
+bool ExtractZipMember(std::string, std::string, FILE*, ZipMemberStats&);
@@ -0,0 +1,675 @@
+#include <batch.hpp>
+#include <hosthealth.hpp>
+#include <plan.hpp>
+#include <util.hpp>
+#include <listreader.hpp>
+#include <jobtable.hpp>
+#include <journal.hpp>
+#include <pack.hpp>
+#include <outputtree.hpp>
+#include <bufferpool.hpp>
+#include <handlepool.hpp>
+#include <eventloops.hpp>
+#include <resolver.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <iostream>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <map>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+
+struct Transfer;
+
+//packed transfers paused for lack of buffer blocks, longest waiting first.
+//Write callbacks queue their transfer from the loop threads
+struct PausedTransfers {
+    std::mutex lock;
+    std::deque<Transfer*> queue;
+    //woken up to hand out blocks or let one transfer past the budget
+    EventLoops* loops = NULL;
+};
+
+struct Transfer {
+    //row of the job in the job table
+    uint32_t job = 0;
+    CURL* curl = NULL;
+    FILE* file = NULL;
+    //body of a download going into the pack, appended to it once complete
+    BufferChain body;
+    StallDetector* detector = NULL;
+    //paused until the buffer pool has blocks again, queued in waiting
+    std::atomic<bool> paused{ false };
+    //allowed past the buffer budget, so a batch whose transfers all wait on each other can go on
+    std::atomic<bool> overdraft{ false };
+    PausedTransfers* waiting = NULL;
+};
+
+struct LaterFirst {
+    const JobTable* table;
+    bool operator()(uint32_t a, uint32_t b) const {
+        return table->NotBefore(a) > table->NotBefore(b);
+    }
+};
+
+//parses a "url [output]" line, false for blank lines and comments
+static bool ParseJob(BatchOptions& opts, std::string& line, BatchJob& job) {
+    std::istringstream fields(line);
+    if (!(fields >> job.url) || job.url[0] == '#') {
+        return false;
+    }
+    if (!(fields >> job.output)) {
+        job.output = FileNameOf(job.url);
+    }
+    if (opts.fanout > 0 && opts.pack == "") {
+        job.output = FanoutPath(job.output, opts.fanout);
+    }
+    job.output = JoinPath(opts.outputDir, job.output);
+    job.host = HostOf(job.url);
+    return true;
+}
+
+static size_t BodyWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    Transfer* t = (Transfer*)ptr;
+    if (!t->body.Append(data, size * nmemb, t->overdraft)) {
+        //out of buffer budget, curl hands the same data over again once resumed
+        {
+            std::lock_guard<std::mutex> guard(t->waiting->lock);
+            t->paused = true;
+            t->waiting->queue.push_back(t);
+        }
+        t->waiting->loops->Wake();
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    return size * nmemb;
+}
+
+//a paused transfer isn't stalled, it is waiting for memory
+static int BodyXferInfo(void* ptr, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    Transfer* t = (Transfer*)ptr;
+    if (t->paused) {
+        t->detector->Reset(NowSeconds());
+        return 0;
+    }
+    return StallXferInfo(t->detector, dltotal, dlnow, ultotal, ulnow);
+}
+
+//points the transfer at the prefetched addresses of its host
+static void ApplyResolved(Resolver* resolver, CURL* curl, JobTable& table, uint32_t job) {
+    if (resolver) {
+        resolver->Apply(curl, table.hosts.Name(table.Host(job)), PortOf(table.Url(job)));
+    }
+}
+
+static bool StartTransfer(EventLoops& loops, JobTable& table, OutputTree& tree, uint32_t job, StallOptions& stall, PausedTransfers* waiting, Resolver* resolver) {
+    Transfer* t = new Transfer();
+    t->job = job;
+    if (waiting) {
+        CURL* curl = Handles().Acquire();
+        t->curl = curl;
+        t->waiting = waiting;
+        curl_easy_setopt(curl, CURLOPT_URL, table.Url(job));
+        ApplyResolved(resolver, curl, table, job);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BodyWrite);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, t);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+        t->detector = new StallDetector(stall);
+        t->detector->Reset(NowSeconds());
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, BodyXferInfo);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, t);
+        loops.Add(curl, table.Host(job));
+        table.SetState(job, JobState::Running);
+        return true;
+    }
+    bool segment = table.RangeStart(job) >= 0;
+    //a partial output of an interrupted run is continued where it stopped
+    curl_off_t offset = 0;
+    time_t mtime;
+    bool resume = !segment && table.Resume(job) && StatFile(OutputTree::TempPath(table.Output(job)), offset, mtime) && offset > 0;
+    t->file = tree.Open(table.Output(job), segment ? "r+b" : (resume ? "ab" : "wb"));
+    if (t->file && segment && SeekFile(t->file, table.RangeStart(job)) != 0) {
+        fclose(t->file);
+        t->file = NULL;
+    }
+    if (!t->file) {
+        std::cout << "error while opening file " << table.Output(job) << std::endl;
+        delete t;
+        return false;
+    }
+    CURL* curl = Handles().Acquire();
+    t->curl = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, table.Url(job));
+    ApplyResolved(resolver, curl, table, job);
+    /* allow redirections */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, t->file);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    if (segment) {
+        std::string range = std::to_string(table.RangeStart(job)) + "-" + std::to_string(table.RangeEnd(job));
+        curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    }
+    if (resume) {
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, offset);
+    }
+    t->detector = new StallDetector(stall);
+    t->detector->Reset(NowSeconds());
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, StallXferInfo);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, t->detector);
+    loops.Add(curl, table.Host(job));
+    table.SetState(job, JobState::Running);
+    return true;
+}
+
+//name of a packed download: its output path below the output directory
+static std::string PackName(BatchOptions& opts, std::string output) {
+    std::string dir = JoinPath(opts.outputDir, "");
+    return output.compare(0, dir.size(), dir) == 0 ? output.substr(dir.size()) : output;
+}
+
+//counts down the segments of a split file, true once the transfer of a whole
+//file or of the last segment of one finished
+static bool Completes(std::map<uint32_t, int>& segmentsLeft, JobTable& table, uint32_t job) {
+    if (table.RangeStart(job) < 0) {
+        return true;
+    }
+    auto s = segmentsLeft.find(table.Index(job));
+    if (s == segmentsLeft.end() || --s->second > 0) {
+        return false;
+    }
+    segmentsLeft.erase(s);
+    return true;
+}
+
+//whether a failed transfer says something about the health of the host
+static bool IsHostFailure(CURLcode code, long status) {
+    if (code != CURLE_OK) {
+        return true;
+    }
+    return status >= 500 || status == 408 || status == 429;
+}
+
+//hands out the next job of the batch, false once there are no more
+typedef std::function<bool(BatchJob&)> JobSource;
+static int RunQueue(BatchOptions, JobSource);
+
+int RunBatch(BatchOptions opts) {
+    ListReader list;
+    if (!list.Open(opts.listFile)) {
+        std::cout << "error while opening batch file " << opts.listFile << std::endl;
+        return 1;
+    }
+    std::cout << "batch: " << opts.listFile << ", " << opts.jobs << " concurrent, " << opts.lookahead << " jobs lookahead" << std::endl;
+    std::string line;
+    long long index = 0;
+    return RunQueue(opts, [&](BatchJob& job) {
+        while (list.NextLine(line)) {
+            job = BatchJob();
+            if (ParseJob(opts, line, job)) {
+                job.index = index++;
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+int RunJobs(BatchOptions opts, std::vector<BatchJob> jobs) {
+    std::cout << "batch: " << jobs.size() << " jobs, " << opts.jobs << " concurrent" << std::endl;
+    size_t next = 0;
+    return RunQueue(opts, [&](BatchJob& job) {
+        if (next == jobs.size()) {
+            return false;
+        }
+        job = jobs[next];
+        job.index = next++;
+        return true;
+    });
+}
+
+static int RunQueue(BatchOptions opts, JobSource next) {
+    //every job pulled from the source and not finished yet lives in the table,
+    //the queues below only hold row numbers
+    JobTable table;
+    std::deque<uint32_t> ready;
+    curl_off_t totalBytes = 0;
+    size_t loaded = 0;
+    bool exhausted = false;
+    int windows = 0;
+    double batchStart = NowSeconds();
+    double lastReport = batchStart;
+    curl_off_t doneBytes = 0;
+    //transfers run on one event loop per thread, sharded by host
+    EventLoops loops(opts.threads, opts.jobs);
+    HealthTracker health;
+    //jobs waiting for their host's breaker to close again, by host id
+    std::map<uint32_t, std::deque<uint32_t>> parked;
+    //jobs waiting for their backoff delay to expire
+    std::priority_queue<uint32_t, std::vector<uint32_t>, LaterFirst> delayed(LaterFirst{ &table });
+    int running = 0;
+    size_t succeeded = 0;
+    size_t failed = 0;
+    size_t skipped = 0;
+    Journal journal;
+    bool journaling = opts.journal != "";
+    if (journaling) {
+        if (!journal.Open(opts.journal)) {
+            std::cout << "error while opening journal " << opts.journal << std::endl;
+            return 1;
+        }
+        std::cout << "journal: " << journal.Replayed() << " records replayed from " << opts.journal << std::endl;
+    }
+    auto commitJournal = [&](double now, bool force) {
+        if (!journal.Commit(now, force)) {
+            std::cout << "error while writing journal " << opts.journal << ", jobs finished from now on are not recorded" << std::endl;
+        }
+    };
+    OutputTree tree;
+    PackWriter packer;
+    bool packed = opts.pack != "";
+    if (packed) {
+        //records are whole bodies, nothing is split into segments
+        opts.minSegment = (curl_off_t)1 << 62;
+        if (!packer.Open(opts.pack, journaling)) {
+            std::cout << "error while opening pack " << opts.pack << std::endl;
+            return 1;
+        }
+    }
+    Resolver resolver;
+    if (opts.dnsPrefetch && !resolver.Open(opts.dnsCache, opts.dnsServer)) {
+        std::cout << "error while opening dns cache " << opts.dnsCache << std::endl;
+        return 1;
+    }
+    PausedTransfers waiting;
+    waiting.loops = &loops;
+    auto anyWaiting = [&]() {
+        std::lock_guard<std::mutex> guard(waiting.lock);
+        return !waiting.queue.empty();
+    };
+    //segments still missing for files split over several transfers, by list position
+    std::map<uint32_t, int> segmentsLeft;
+    //transfers that finished while a window was being probed
+    std::vector<LoopDone> finishedEarly;
+
+    //pulls the next window of jobs once the ready queue runs low. Only the
+    //jobs of the lookahead window are held in memory; in lpt mode each
+    //window is probed and planned on its own
+    auto refill = [&]() {
+        size_t pending = table.Live();
+        if (exhausted || ready.size() >= (size_t)opts.jobs || pending >= opts.lookahead) {
+            return;
+        }
+        std::vector<BatchJob> window;
+        BatchJob job;
+        while (pending + window.size() < opts.lookahead) {
+            if (!next(job)) {
+                exhausted = true;
+                break;
+            }
+            if (journaling) {
+                uint32_t key = Journal::KeyOf(job.url.c_str(), job.output.c_str());
+                if (journal.IsDone((uint32_t)job.index, key)) {
+                    skipped++;
+                    continue;
+                }
+                job.resume = journal.WasStarted((uint32_t)job.index, key);
+            }
+            window.push_back(job);
+        }
+        if (window.empty()) {
+            return;
+        }
+        loaded += window.size();
+        windows++;
+        if (opts.dnsPrefetch) {
+            std::vector<std::string> names;
+            for (BatchJob& j : window) {
+                names.push_back(j.host);
+            }
+            resolver.Prefetch(names);
+        }
+        if (!packed) {
+            std::vector<std::string> outputs;
+            for (BatchJob& j : window) {
+                outputs.push_back(j.output);
+            }
+            tree.Prepare(outputs);
+        }
+        if (opts.schedule != "lpt") {
+            for (BatchJob& j : window) {
+                ready.push_back(table.Add(j));
+            }
+            return;
+        }
+        //the running transfers go on while the window is probed, a frozen
+        //transfer would be taken for stalled once the round is over
+        ProbeJobs(window, opts.jobs, opts.dnsPrefetch ? &resolver : NULL, [&](int wait) {
+            loops.Wait(finishedEarly, wait);
+        });
+        curl_off_t fifo = PlannedMakespan(std::deque<BatchJob>(window.begin(), window.end()), opts.jobs);
+        std::deque<BatchJob> planned = PlanLpt(window, opts.jobs, opts.minSegment);
+        curl_off_t windowBytes = 0;
+        for (BatchJob& j : window) {
+            if (j.size > 0) {
+                windowBytes += j.size;
+            }
+        }
+        totalBytes += windowBytes;
+        //segments of the same file write into one preallocated output
+        std::map<std::string, curl_off_t> segmented;
+        for (BatchJob& j : planned) {
+            if (j.rangeStart >= 0 && j.rangeEnd + 1 > segmented[j.output]) {
+                segmented[j.output] = j.rangeEnd + 1;
+            }
+        }
+        for (auto& f : segmented) {
+            PreallocateOutput(OutputTree::TempPath(f.first), f.second);
+        }
+        if (windows == 1 || opts.verbose) {
+            std::cout << "plan: " << windowBytes << " bytes in " << planned.size() << " transfers, busiest slot "
+                << PlannedMakespan(planned, opts.jobs) << " bytes (fifo: " << fifo << ")" << std::endl;
+        }
+        for (BatchJob& j : planned) {
+            if (j.rangeStart >= 0) {
+                segmentsLeft[(uint32_t)j.index]++;
+            }
+            ready.push_back(table.Add(j));
+        }
+    };
+
+    auto fail = [&](uint32_t job, std::string reason) {
+        segmentsLeft.erase(table.Index(job));
+        std::cout << "failed: " << table.Url(job) << " (" << reason << ")" << std::endl;
+        if (!packed) {
+            tree.Discard(table.Output(job));
+        }
+        table.Release(job);
+        failed++;
+    };
+    auto park = [&](uint32_t job) {
+        table.SetState(job, JobState::Parked);
+        parked[table.Host(job)].push_back(job);
+    };
+    auto unpark = [&](std::deque<uint32_t>& jobs, bool front) {
+        for (uint32_t j : jobs) {
+            table.SetState(j, JobState::Ready);
+        }
+        ready.insert(front ? ready.begin() : ready.end(), jobs.begin(), jobs.end());
+    };
+
+    refill();
+    int timeout = 0;
+    while (!ready.empty() || !delayed.empty() || !parked.empty() || running > 0) {
+        double now = NowSeconds();
+        while (!delayed.empty() && table.NotBefore(delayed.top()) <= now) {
+            table.SetState(delayed.top(), JobState::Ready);
+            ready.push_back(delayed.top());
+            delayed.pop();
+        }
+        //let one probe through for every parked host that is due
+        for (auto it = parked.begin(); it != parked.end();) {
+            if (!it->second.empty() && now >= health.NextProbe(table.hosts.Name(it->first))) {
+                table.SetState(it->second.front(), JobState::Ready);
+                ready.push_front(it->second.front());
+                it->second.pop_front();
+            }
+            if (it->second.empty()) {
+                it = parked.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+        size_t scanned = ready.size();
+        //while transfers wait for memory no new ones are started
+        bool paused = anyWaiting();
+        while (running < opts.jobs && scanned > 0 && !paused) {
+            uint32_t job = ready.front();
+            ready.pop_front();
+            scanned--;
+            const std::string& host = table.hosts.Name(table.Host(job));
+            if (!health.CanDispatch(host, now)) {
+                park(job);
+                continue;
+            }
+            if (StartTransfer(loops, table, tree, job, opts.stall, packed ? &waiting : NULL, opts.dnsPrefetch ? &resolver : NULL)) {
+                running++;
+                if (journaling && table.RangeStart(job) < 0) {
+                    journal.Started(table.Index(job), Journal::KeyOf(table.Url(job), table.Output(job)));
+                }
+            }
+            else {
+                health.CancelProbe(host, now);
+                table.Release(job);
+                failed++;
+            }
+        }
+
+        //runs the transfers until some finish or the timeout expires
+        std::vector<LoopDone> finished;
+        finished.swap(finishedEarly);
+        loops.Wait(finished, finished.empty() ? timeout : 0);
+        now = NowSeconds();
+        for (LoopDone& d : finished) {
+            CURL* curl = d.curl;
+            CURLcode code = d.result;
+            Transfer* t = NULL;
+            long status = 0;
+            double ttfb = 0;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&t);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &ttfb);
+            curl_off_t received = 0;
+            curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+            char* type = NULL;
+            curl_easy_getinfo(curl, CURLINFO_CONTENT_TYPE, &type);
+            std::string contentType = type ? type : "";
+            Network().Record(curl);
+            Handles().Release(curl);
+            if (t->paused) {
+                std::lock_guard<std::mutex> guard(waiting.lock);
+                waiting.queue.erase(std::find(waiting.queue.begin(), waiting.queue.end(), t));
+            }
+            if (t->file) {
+                fclose(t->file);
+            }
+            delete t->detector;
+            running--;
+
+            uint32_t job = t->job;
+            uint32_t hostId = table.Host(job);
+            const std::string& host = table.hosts.Name(hostId);
+            now = NowSeconds();
+            bool ignoredRange = table.RangeStart(job) >= 0 && status == 200;
+            //any answer that isn't a host failure (a 404 too) shows the host is
+            //reachable, which also settles a half-open probe
+            if (!IsHostFailure(code, status) || code == CURLE_RANGE_ERROR) {
+                health.OnSuccess(host, ttfb);
+                //host is healthy again, hand its parked jobs back
+                auto p = parked.find(hostId);
+                if (p != parked.end()) {
+                    unpark(p->second, true);
+                    parked.erase(p);
+                }
+            }
+            if (table.Resume(job) && (code == CURLE_RANGE_ERROR || status == 416)) {
+                //the partial output can't be continued, start it over
+                table.SetResume(job, false);
+                table.SetState(job, JobState::Ready);
+                ready.push_back(job);
+            }
+            else if (ignoredRange) {
+                fail(job, "server ignored the range request");
+            }
+            else if (code == CURLE_OK && status < 400 && packed && !packer.Add(PackName(opts, table.Output(job)), table.Url(job), contentType, t->body)) {
+                fail(job, "error while writing pack");
+            }
+            else if (code == CURLE_OK && status < 400 && !packed && !Completes(segmentsLeft, table, job)) {
+                //a segment of a file whose other segments are still running
+                doneBytes += received;
+                table.Release(job);
+            }
+            else if (code == CURLE_OK && status < 400 && !packed && !tree.Publish(table.Output(job))) {
+                fail(job, "error while moving the file in place");
+            }
+            else if (code == CURLE_OK && status < 400) {
+                doneBytes += received;
+                succeeded++;
+                if (opts.verbose) {
+                    std::cout << "done: " << table.Url(job) << std::endl;
+                }
+                if (journaling) {
+                    journal.Finished(table.Index(job), Journal::KeyOf(table.Url(job), table.Output(job)));
+                }
+                table.Release(job);
+            }
+            else if (!IsHostFailure(code, status)) {
+                fail(job, "HTTP " + std::to_string(status));
+            }
+            else {
+                bool stalled = code == CURLE_ABORTED_BY_CALLBACK;
+                health.OnFailure(host, code == CURLE_OPERATION_TIMEDOUT || stalled, now);
+                std::string reason = stalled ? "stalled" : (code != CURLE_OK) ? curl_easy_strerror(code) : "HTTP " + std::to_string(status);
+                auto& h = health.Hosts().at(host);
+                int attempts = table.AddAttempt(job);
+                if (attempts > opts.maxRetries) {
+                    fail(job, reason);
+                }
+                else {
+                    table.SetNotBefore(job, now + health.Backoff(attempts));
+                    table.SetState(job, JobState::Delayed);
+                    delayed.push(job);
+                }
+                //the breaker kept tripping, give up on everything parked for this host
+                if (h.trips > opts.maxRetries) {
+                    auto p = parked.find(hostId);
+                    if (p != parked.end()) {
+                        for (uint32_t j : p->second) {
+                            fail(j, "host " + host + " is down");
+                        }
+                        parked.erase(p);
+                    }
+                }
+            }
+            delete t;
+        }
+
+        //hand the blocks freed by finished bodies to the paused transfers in
+        //turn. Resuming may pause one again right away, it then queues at the end
+        std::vector<Transfer*> resume;
+        {
+            std::lock_guard<std::mutex> guard(waiting.lock);
+            std::deque<Transfer*>& queue = waiting.queue;
+            for (size_t n = queue.size(); n > 0 && !queue.empty() && Buffers().Available(); n--) {
+                resume.push_back(queue.front());
+                queue.pop_front();
+            }
+            //every running transfer waits for blocks only the others could free,
+            //the longest waiting one may go past the budget to finish
+            if (!queue.empty() && (int)queue.size() == running) {
+                queue.front()->overdraft = true;
+                resume.push_back(queue.front());
+                queue.pop_front();
+            }
+            for (Transfer* w : resume) {
+                w->paused = false;
+            }
+        }
+        for (Transfer* w : resume) {
+            loops.Resume(w->curl);
+        }
+
+        refill();
+        if (journaling) {
+            //finished jobs must be in the pack before the journal says so
+            if (packed) {
+                packer.Flush();
+            }
+            commitJournal(now, false);
+        }
+        if (opts.verbose && totalBytes > 0 && now - lastReport >= 5 && doneBytes > 0) {
+            double rate = doneBytes / (now - batchStart);
+            std::cout << "progress: " << doneBytes << "/" << totalBytes << " bytes, ETA "
+                << (int)((totalBytes - doneBytes) / rate) << "s" << std::endl;
+            lastReport = now;
+        }
+
+        //how long the next round may wait for transfers, until a timer expires
+        timeout = 1000;
+        if (!delayed.empty()) {
+            timeout = std::min(timeout, (int)((table.NotBefore(delayed.top()) - now) * 1000) + 1);
+        }
+        for (auto& p : parked) {
+            double next = health.NextProbe(table.hosts.Name(p.first)) - now;
+            if (next < 1.0) {
+                timeout = std::min(timeout, (int)(next * 1000) + 1);
+            }
+        }
+        if (!ready.empty() && running < opts.jobs && !anyWaiting()) {
+            timeout = 0;
+        }
+        timeout = std::max(timeout, 0);
+    }
+
+    if (packed) {
+        packer.Close();
+        std::cout << "pack: " << packer.Records() << " records in " << opts.pack << std::endl;
+    }
+    if (journaling) {
+        commitJournal(NowSeconds(), true);
+    }
+    if (opts.dnsPrefetch && !resolver.Save()) {
+        std::cout << "error while writing dns cache " << opts.dnsCache << std::endl;
+    }
+
+    std::cout << "batch finished: " << succeeded << " succeeded, " << failed << " failed";
+    if (skipped > 0) {
+        std::cout << ", " << skipped << " already done";
+    }
+    std::cout << " in " << NowSeconds() - batchStart << "s" << std::endl;
+    for (auto& h : health.Hosts()) {
+        if (h.second.failures > 0) {
+            std::cout << "  " << h.first << ": " << h.second.failures << " failures (" << h.second.timeouts << " timeouts), "
+                << h.second.totalTrips << " breaker trips, avg latency " << h.second.avgLatency << "s" << std::endl;
+        }
+    }
+    if (opts.verbose) {
+        std::cout << "  " << loaded << " jobs read in " << windows << " windows, " << table.hosts.Size() << " hosts, job table "
+            << table.MemoryBytes() << " bytes, peak memory " << PeakMemoryKb() << " KiB (" << Buffers().Peak() / 1024 << " KiB body buffers), "
+            << Handles().Created() << " curl handles for " << Handles().Created() + Handles().Reused() << " transfers, "
+            << loops.Loops() << " event loops" << std::endl;
+        if (Sessions().Active() && Sessions().Resumed() >= 0) {
+            std::cout << "  tls: " << Sessions().Loaded() << " cached sessions, " << Sessions().Resumed() << " resumed and "
+                << Sessions().Full() << " full handshakes" << std::endl;
+        }
+        if (opts.dnsPrefetch) {
+            std::cout << "  dns: " << resolver.Queries() << " queries, " << resolver.Cached() << " hosts from the cache" << std::endl;
+        }
+        if (Network().Active()) {
+            std::vector<double> rtts;
+            size_t fixed = 0;
+            for (auto& h : Network().Hosts()) {
+                if (h.second.rtt > 0) {
+                    rtts.push_back(h.second.rtt);
+                }
+                if (h.second.buffer > 0) {
+                    fixed++;
+                }
+            }
+            std::sort(rtts.begin(), rtts.end());
+            std::cout << "  net " << Network().Name() << ": " << rtts.size() << " hosts measured, median rtt "
+                << (rtts.empty() ? 0 : rtts[rtts.size() / 2] * 1000) << " ms, " << fixed << " with a fixed receive buffer" << std::endl;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}
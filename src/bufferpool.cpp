@@ -0,0 +1,138 @@
+#include <bufferpool.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+//blocks kept for reuse when there is no budget to bound them
+static const size_t maxFreeBlocks = 4096;
+
+BufferPool::BufferPool() : budget(0), inUse(0), peak(0) {}
+
+BufferPool::~BufferPool() {
+    for (char* b : spare) {
+        free(b);
+    }
+}
+
+void BufferPool::SetBudget(size_t bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    budget = bytes;
+}
+
+size_t BufferPool::Budget() {
+    std::lock_guard<std::mutex> guard(lock);
+    return budget;
+}
+
+char* BufferPool::Acquire(bool force) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!force && budget > 0 && inUse + blockSize > budget) {
+        return NULL;
+    }
+    char* block;
+    if (!spare.empty()) {
+        block = spare.back();
+        spare.pop_back();
+    }
+    else if (!(block = (char*)malloc(blockSize))) {
+        return NULL;
+    }
+    inUse += blockSize;
+    peak = std::max(peak, inUse);
+    return block;
+}
+
+void BufferPool::Release(char* block) {
+    std::lock_guard<std::mutex> guard(lock);
+    inUse -= blockSize;
+    //the budget bounds the blocks in use and kept together
+    size_t limit = budget > 0 ? budget : maxFreeBlocks * blockSize;
+    if (inUse + (spare.size() + 1) * blockSize <= limit) {
+        spare.push_back(block);
+    }
+    else {
+        free(block);
+    }
+}
+
+bool BufferPool::Available() {
+    std::lock_guard<std::mutex> guard(lock);
+    return budget == 0 || inUse + blockSize <= budget;
+}
+
+size_t BufferPool::InUse() {
+    std::lock_guard<std::mutex> guard(lock);
+    return inUse;
+}
+
+size_t BufferPool::Peak() {
+    std::lock_guard<std::mutex> guard(lock);
+    return peak;
+}
+
+BufferPool& Buffers() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferChain::BufferChain() : size(0) {}
+
+BufferChain::BufferChain(BufferChain&& other) noexcept : blocks(std::move(other.blocks)), size(other.size) {
+    other.blocks.clear();
+    other.size = 0;
+}
+
+BufferChain::~BufferChain() {
+    Clear();
+}
+
+bool BufferChain::Append(const char* data, size_t len, bool force) {
+    const size_t blockSize = BufferPool::blockSize;
+    size_t have = blocks.size();
+    size_t needed = (size + len + blockSize - 1) / blockSize;
+    while (blocks.size() < needed) {
+        char* block = Buffers().Acquire(force);
+        if (!block) {
+            //all or nothing, a paused transfer gets the same data again
+            while (blocks.size() > have) {
+                Buffers().Release(blocks.back());
+                blocks.pop_back();
+            }
+            return false;
+        }
+        blocks.push_back(block);
+    }
+    while (len > 0) {
+        size_t at = size % blockSize;
+        size_t n = std::min(len, blockSize - at);
+        memcpy(blocks[size / blockSize] + at, data, n);
+        data += n;
+        len -= n;
+        size += n;
+    }
+    return true;
+}
+
+size_t BufferChain::Size() const {
+    return size;
+}
+
+size_t BufferChain::Blocks() const {
+    return blocks.size();
+}
+
+const char* BufferChain::Block(size_t i) const {
+    return blocks[i];
+}
+
+size_t BufferChain::BlockLength(size_t i) const {
+    return std::min(BufferPool::blockSize, size - i * BufferPool::blockSize);
+}
+
+void BufferChain::Clear() {
+    for (char* b : blocks) {
+        Buffers().Release(b);
+    }
+    blocks.clear();
+    size = 0;
+}
@@ -0,0 +1,186 @@
+#include <check.hpp>
+#include <util.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <iostream>
+#include <listreader.hpp>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+struct Probe {
+    std::string url;
+    bool ranged = false;
+    //total size from the Content-Range of a ranged probe
+    curl_off_t total = -1;
+    long status = 0;
+    //the server ignored the range and the body was cut off after the headers
+    bool cut = false;
+};
+
+static size_t DiscardBody(char* data, size_t size, size_t nmemb, void* ptr) {
+    Probe* p = (Probe*)ptr;
+    if (p->status != 206) {
+        //the whole body is coming, status and length are all a check needs
+        p->cut = true;
+        return 0;
+    }
+    return size * nmemb;
+}
+
+static size_t RangedHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    Probe* p = (Probe*)ptr;
+    size_t len = size * nitems;
+    if (len > 5 && curl_strnequal(buffer, "http/", 5)) {
+        std::string line(buffer, len);
+        p->status = atol(line.c_str() + line.find(' '));
+        p->total = -1;
+    }
+    else if (len > 14 && curl_strnequal(buffer, "content-range:", 14)) {
+        std::string line(buffer, len);
+        size_t slash = line.find('/');
+        if (slash != std::string::npos && line[slash + 1] != '*') {
+            p->total = strtoll(line.c_str() + slash + 1, NULL, 10);
+        }
+    }
+    return len;
+}
+
+static void SetupProbe(CURL* curl, Probe* p, long timeout) {
+    curl_easy_reset(curl);
+    Sessions().Attach(curl);
+    Network().Apply(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, p->url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, p);
+    if (p->ranged) {
+        curl_easy_setopt(curl, CURLOPT_RANGE, "0-0");
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, DiscardBody);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, p);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, RangedHeader);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, p);
+    }
+    else {
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    }
+}
+
+//reads the next url of the list, false at its end
+static bool NextUrl(ListReader& in, std::string& url) {
+    std::string line;
+    while (in.NextLine(line)) {
+        std::istringstream fields(line);
+        if ((fields >> url) && url[0] != '#') {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RunCheck(CheckOptions opts, CheckStats& stats) {
+    ListReader list;
+    if (opts.listFile != "" && !list.Open(opts.listFile)) {
+        std::cout << "error while opening batch file " << opts.listFile << std::endl;
+        return false;
+    }
+    bool single = opts.listFile == "";
+
+    CURLM* multi = curl_multi_init();
+    //easy handles are kept and reused instead of created per url
+    std::vector<CURL*> idle;
+    int running = 0;
+    bool more = true;
+    double started = NowSeconds();
+    while (more || running > 0) {
+        std::string url;
+        while (more && running < opts.connections) {
+            if (single ? opts.url == "" : !NextUrl(list, url)) {
+                more = false;
+                break;
+            }
+            if (single) {
+                url = opts.url;
+                opts.url = "";
+            }
+            Probe* p = new Probe();
+            p->url = url;
+            CURL* curl;
+            if (idle.empty()) {
+                curl = curl_easy_init();
+            }
+            else {
+                curl = idle.back();
+                idle.pop_back();
+            }
+            SetupProbe(curl, p, opts.timeout);
+            curl_multi_add_handle(multi, curl);
+            running++;
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int msgs = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &msgs))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL* curl = msg->easy_handle;
+            Probe* p = NULL;
+            long status = 0;
+            curl_off_t size = -1;
+            double total = 0;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&p);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+            curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi, curl);
+
+            if (!p->ranged && code == CURLE_OK && (status == 405 || status == 501)) {
+                //HEAD not allowed here, ask for the first byte instead
+                p->ranged = true;
+                stats.fallbacks++;
+                SetupProbe(curl, p, opts.timeout);
+                curl_multi_add_handle(multi, curl);
+                continue;
+            }
+            if (p->ranged) {
+                size = (status == 206) ? p->total : size;
+                if (p->cut && code == CURLE_WRITE_ERROR) {
+                    code = CURLE_OK;
+                }
+            }
+            idle.push_back(curl);
+            running--;
+            stats.checked++;
+            bool ok = code == CURLE_OK && status < 400;
+            if (!ok) {
+                stats.broken++;
+            }
+            //status size latency url, "ERR" with curl's reason when there was no response
+            if (code != CURLE_OK) {
+                printf("ERR - %ld %s (%s)\n", (long)(total * 1000), p->url.c_str(), curl_easy_strerror(code));
+            }
+            else {
+                printf("%ld %lld %ld %s\n", status, (long long)size, (long)(total * 1000), p->url.c_str());
+            }
+            delete p;
+        }
+        if (running > 0 && (running >= opts.connections || !more)) {
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+    }
+    fflush(stdout);
+    double elapsed = NowSeconds() - started;
+    for (CURL* curl : idle) {
+        curl_easy_cleanup(curl);
+    }
+    curl_multi_cleanup(multi);
+    std::cerr << stats.checked << " urls checked, " << stats.broken << " broken, " << stats.fallbacks << " without HEAD support, "
+        << (elapsed > 0 ? (long long)(stats.checked / elapsed) : 0) << " checks/s" << std::endl;
+    return stats.broken == 0;
+}
@@ -0,0 +1,412 @@
+#include <crawl.hpp>
+#include <util.hpp>
+#include <handlepool.hpp>
+#include <iostream>
+#include <deque>
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+
+static uint64_t Fnv1a(const std::string& s, uint64_t seed) {
+    uint64_t h = 14695981039346656037ULL ^ seed;
+    for (size_t i = 0; i < s.size(); i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+BloomFilter::BloomFilter(uint64_t expected) {
+    //m = -n ln(p) / ln(2)^2 and k = m/n ln(2) for p = 0.01
+    size = (uint64_t)(expected * 9.6) + 64;
+    hashes = 7;
+    bits.assign((size + 63) / 64, 0);
+}
+
+bool BloomFilter::Insert(const std::string& key) {
+    //double hashing: h1 + i*h2 gives the k positions
+    uint64_t h1 = Fnv1a(key, 0);
+    uint64_t h2 = Fnv1a(key, 0x9e3779b97f4a7c15ULL) | 1;
+    bool added = false;
+    for (int i = 0; i < hashes; i++) {
+        uint64_t bit = (h1 + i * h2) % size;
+        uint64_t mask = 1ULL << (bit & 63);
+        if (!(bits[bit >> 6] & mask)) {
+            bits[bit >> 6] |= mask;
+            added = true;
+        }
+    }
+    return added;
+}
+
+LinkExtractor::LinkExtractor() {
+    state = State::Text;
+    quote = 0;
+}
+
+void LinkExtractor::EndValue() {
+    if (element == "base") {
+        //only the first <base href> counts
+        if (name == "href" && base.empty()) {
+            base = value;
+        }
+    }
+    else if ((name == "href" || name == "src") && !value.empty()) {
+        links.push_back(value);
+    }
+    value.clear();
+    name.clear();
+}
+
+void LinkExtractor::Feed(const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        switch (state) {
+        case State::Text:
+            if (c == '<') {
+                state = State::Tag;
+                element.clear();
+                name.clear();
+            }
+            break;
+        case State::Tag:
+            //the element name, attributes start after whitespace
+            if (c == '>') {
+                state = State::Text;
+            }
+            else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                state = State::Name;
+                name.clear();
+            }
+            else if (element.size() < 16) {
+                element += (char)tolower((unsigned char)c);
+            }
+            break;
+        case State::Name:
+            if (c == '>') {
+                state = State::Text;
+            }
+            else if (c == '=') {
+                state = State::Value;
+            }
+            else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '/') {
+                if (!name.empty()) {
+                    state = State::AfterName;
+                }
+            }
+            else if (name.size() < 16) {
+                name += (char)tolower((unsigned char)c);
+            }
+            break;
+        case State::AfterName:
+            if (c == '=') {
+                state = State::Value;
+            }
+            else if (c == '>') {
+                state = State::Text;
+            }
+            else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                //an attribute without value, this starts the next one
+                name.clear();
+                name += (char)tolower((unsigned char)c);
+                state = State::Name;
+            }
+            break;
+        case State::Value:
+            if (c == '"' || c == '\'') {
+                quote = c;
+                state = State::QuotedValue;
+                value.clear();
+            }
+            else if (c == '>') {
+                EndValue();
+                state = State::Text;
+            }
+            else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                if (!value.empty()) {
+                    EndValue();
+                    state = State::Name;
+                }
+            }
+            else if (value.size() < 4096) {
+                value += c;
+            }
+            break;
+        case State::QuotedValue:
+            if (c == quote) {
+                EndValue();
+                state = State::Name;
+            }
+            else if (value.size() < 4096) {
+                value += c;
+            }
+            break;
+        }
+    }
+}
+
+struct CrawlPage {
+    std::string url;
+    int depth = 0;
+};
+
+struct Crawler;
+
+struct CrawlTransfer {
+    Crawler* crawler;
+    CrawlPage page;
+    long status = 0;
+    std::string path;
+    FILE* file = NULL;
+    bool html = false;
+    bool typeSeen = false;
+    LinkExtractor extractor;
+    //what the page's links resolve against: the url after redirects
+    std::string base;
+    CURL* handle = NULL;
+};
+
+struct Crawler {
+    CrawlOptions opts;
+    std::string scope;
+    std::string startHost;
+    BloomFilter seen;
+    std::map<std::string, std::deque<CrawlPage>> frontier;
+    std::map<std::string, int> hostRunning;
+    std::map<std::string, double> hostLast;
+    long long queued = 0;
+    CrawlStats* stats;
+    Crawler(CrawlOptions o) : opts(o), seen(o.expectedUrls) {}
+};
+
+//splits a url into the part without query/fragment and the query
+static std::string StripFragment(std::string url) {
+    size_t hash = url.find('#');
+    return hash == std::string::npos ? url : url.substr(0, hash);
+}
+
+static std::string PathOf(std::string url) {
+    size_t end = url.find_first_of("?#");
+    return url.substr(0, end);
+}
+
+static void Enqueue(Crawler& c, CrawlPage& from, std::string base, std::string link) {
+    if (link.compare(0, 7, "mailto:") == 0 || link.compare(0, 11, "javascript:") == 0 || link.compare(0, 5, "data:") == 0) {
+        return;
+    }
+    if (from.depth >= c.opts.maxDepth) {
+        return;
+    }
+    std::string url = StripFragment(ResolveUrl(base, link));
+    if (url.compare(0, 7, "http://") != 0 && url.compare(0, 8, "https://") != 0) {
+        return;
+    }
+    //stay on the start host, and below the start directory
+    if (c.opts.noParent ? url.compare(0, c.scope.size(), c.scope) != 0 : HostOf(url) != c.startHost) {
+        return;
+    }
+    //sort/view variants of the same listing
+    if (url.find('?') != std::string::npos && PathOf(url) == PathOf(base)) {
+        return;
+    }
+    if (!c.seen.Insert(url)) {
+        return;
+    }
+    CrawlPage page;
+    page.url = url;
+    page.depth = from.depth + 1;
+    c.frontier[HostOf(url)].push_back(page);
+    c.queued++;
+    c.stats->links++;
+}
+
+static std::string OutputPath(std::string dir, std::string url) {
+    size_t scheme = url.find("://");
+    std::string rest = url.substr(scheme + 3);
+    size_t q = rest.find('?');
+    std::string query = "";
+    if (q != std::string::npos) {
+        query = rest.substr(q);
+        rest = rest.substr(0, q);
+    }
+    if (rest.find('/') == std::string::npos) {
+        rest += "/";
+    }
+    if (rest[rest.size() - 1] == '/') {
+        rest += "index.html";
+    }
+    for (size_t i = 0; i < query.size(); i++) {
+        if (query[i] == '/' || query[i] == '\\') {
+            query[i] = '_';
+        }
+    }
+    return JoinPath(dir, rest + query);
+}
+
+static size_t CrawlHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    CrawlTransfer* t = (CrawlTransfer*)ptr;
+    std::string line(buffer, size * nitems);
+    std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+    if (line.compare(0, 5, "http/") == 0) {
+        t->html = false;
+        t->typeSeen = false;
+        t->status = atol(line.c_str() + line.find(' '));
+    }
+    else if (line.compare(0, 13, "content-type:") == 0 && t->status < 300) {
+        t->typeSeen = true;
+        t->html = line.find("text/html") != std::string::npos || line.find("xhtml") != std::string::npos;
+    }
+    return size * nitems;
+}
+
+static size_t CrawlWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    CrawlTransfer* t = (CrawlTransfer*)ptr;
+    size_t len = size * nmemb;
+    if (!t->file) {
+        //the body comes after the last redirect: a page moved from dir to
+        //dir/ is saved, and has its relative links resolved, below dir/
+        char* effective = NULL;
+        curl_easy_getinfo(t->handle, CURLINFO_EFFECTIVE_URL, &effective);
+        t->base = effective ? effective : t->page.url;
+        if (t->base != t->page.url) {
+            t->path = OutputPath(t->crawler->opts.outputDir, t->base);
+            t->crawler->seen.Insert(StripFragment(t->base));
+        }
+        MakeParentDirs(t->path);
+        t->file = fopen(t->path.c_str(), "wb");
+        if (!t->file) {
+            std::cout << "error while opening file " << t->path << std::endl;
+            return 0;
+        }
+        if (!t->typeSeen && t->status < 300) {
+            //no Content-Type, go by the name
+            std::string name = PathOf(t->page.url);
+            t->html = name[name.size() - 1] == '/' || (name.size() > 5 && name.compare(name.size() - 5, 5, ".html") == 0) ||
+                (name.size() > 4 && name.compare(name.size() - 4, 4, ".htm") == 0);
+        }
+    }
+    if (t->html) {
+        //links join the frontier while the page is still coming in
+        t->extractor.Feed(data, len);
+        //a <base href> takes precedence over the page's own url
+        std::string base = t->extractor.base.empty() ? t->base : ResolveUrl(t->base, t->extractor.base);
+        for (size_t i = 0; i < t->extractor.links.size(); i++) {
+            Enqueue(*t->crawler, t->page, base, t->extractor.links[i]);
+        }
+        t->extractor.links.clear();
+    }
+    return fwrite(data, 1, len, t->file) == len ? len : 0;
+}
+
+static void StartPage(CURLM* multi, Crawler& c, CrawlPage& page) {
+    CrawlTransfer* t = new CrawlTransfer();
+    t->crawler = &c;
+    t->page = page;
+    t->path = OutputPath(c.opts.outputDir, page.url);
+    CURL* curl = Handles().Acquire();
+    t->handle = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, page.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, CrawlHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, t);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CrawlWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, t);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    curl_multi_add_handle(multi, curl);
+}
+
+bool Crawl(std::string url, CrawlOptions opts, CrawlStats& stats) {
+    Crawler c(opts);
+    c.stats = &stats;
+    c.startHost = HostOf(url);
+    //the directory part of the start url bounds the crawl
+    size_t slash = url.find_last_of('/');
+    c.scope = (slash != std::string::npos && slash > url.find("://") + 2) ? url.substr(0, slash + 1) : url + "/";
+    c.seen.Insert(url);
+    CrawlPage start;
+    start.url = url;
+    c.frontier[c.startHost].push_back(start);
+    c.queued = 1;
+
+    CURLM* multi = curl_multi_init();
+    int running = 0;
+    while (c.queued > 0 || running > 0) {
+        double now = NowSeconds();
+        //round robin over the hosts that may take another request
+        bool started = true;
+        double wake;
+        while (started && running < opts.connections) {
+            started = false;
+            for (auto it = c.frontier.begin(); it != c.frontier.end() && running < opts.connections;) {
+                std::string host = it->first;
+                bool polite = c.hostRunning[host] < opts.hostConnections && now - c.hostLast[host] >= opts.hostDelay;
+                if (polite && !it->second.empty()) {
+                    StartPage(multi, c, it->second.front());
+                    it->second.pop_front();
+                    c.queued--;
+                    c.hostRunning[host]++;
+                    c.hostLast[host] = now;
+                    running++;
+                    started = true;
+                }
+                if (it->second.empty()) {
+                    it = c.frontier.erase(it);
+                }
+                else {
+                    it++;
+                }
+            }
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int msgs = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &msgs))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CrawlTransfer* t = NULL;
+            long status = 0;
+            curl_off_t size = 0;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&t);
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            Handles().Release(msg->easy_handle);
+            running--;
+            c.hostRunning[HostOf(t->page.url)]--;
+            if (t->file) {
+                fclose(t->file);
+            }
+            if (code == CURLE_OK && status < 400) {
+                stats.fetched++;
+                stats.bytes += size;
+                if (opts.verbose) {
+                    std::cout << "fetched: " << t->page.url << std::endl;
+                }
+            }
+            else {
+                stats.failed++;
+                remove(t->path.c_str());
+                std::cout << "failed: " << t->page.url << std::endl;
+            }
+            delete t;
+        }
+        //don't sleep while links found during this round could be started
+        now = NowSeconds();
+        wake = now + 1;
+        for (auto& f : c.frontier) {
+            if (running < opts.connections && c.hostRunning[f.first] < opts.hostConnections) {
+                wake = std::min(wake, c.hostLast[f.first] + opts.hostDelay);
+            }
+        }
+        curl_multi_poll(multi, NULL, 0, std::max(0, (int)((wake - now) * 1000)), NULL);
+    }
+    curl_multi_cleanup(multi);
+    return stats.failed == 0;
+}
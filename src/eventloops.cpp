@@ -0,0 +1,225 @@
+#include <eventloops.hpp>
+#include <tlssessions.hpp>
+#include <climits>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+struct EventLoop {
+    CURLM* multi = NULL;
+    //dns and tls sessions of the loop, the handles of every loop are reset by the batch thread
+    CURLSH* share = NULL;
+    std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+    //the fields below are guarded by the lock of EventLoops
+    std::deque<CURL*> queue;
+    std::vector<CURL*> resume;
+    int running = 0;
+    int capacity = INT_MAX;
+    std::thread thread;
+};
+
+static void ShareLock(CURL*, curl_lock_data data, curl_lock_access, void* ptr) {
+    ((EventLoop*)ptr)->shareLocks[data].lock();
+}
+
+static void ShareUnlock(CURL*, curl_lock_data data, void* ptr) {
+    ((EventLoop*)ptr)->shareLocks[data].unlock();
+}
+
+EventLoops::EventLoops(int count, int concurrency) : woken(false), stop(false) {
+    if (count < 1) {
+        count = 1;
+    }
+    for (int i = 0; i < count; i++) {
+        EventLoop* loop = new EventLoop();
+        loop->multi = curl_multi_init();
+        loops.push_back(loop);
+    }
+    if (count == 1) {
+        return;
+    }
+    unsigned int cores = std::thread::hardware_concurrency();
+    for (int i = 0; i < count; i++) {
+        EventLoop* loop = loops[i];
+        loop->capacity = (concurrency + count - 1) / count;
+        //the handles keep the process-wide session cache, the multi's dns cache is the loop's anyway
+        if (!Sessions().Active()) {
+            loop->share = curl_share_init();
+            curl_share_setopt(loop->share, CURLSHOPT_LOCKFUNC, ShareLock);
+            curl_share_setopt(loop->share, CURLSHOPT_UNLOCKFUNC, ShareUnlock);
+            curl_share_setopt(loop->share, CURLSHOPT_USERDATA, loop);
+            curl_share_setopt(loop->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(loop->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+        loop->thread = std::thread(&EventLoops::Run, this, loop);
+#ifdef __linux__
+        if (cores > 1) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cores, &set);
+            pthread_setaffinity_np(loop->thread.native_handle(), sizeof(set), &set);
+        }
+#endif
+    }
+}
+
+EventLoops::~EventLoops() {
+    stop = true;
+    for (EventLoop* loop : loops) {
+        curl_multi_wakeup(loop->multi);
+    }
+    for (EventLoop* loop : loops) {
+        if (loop->thread.joinable()) {
+            loop->thread.join();
+        }
+        curl_multi_cleanup(loop->multi);
+        if (loop->share) {
+            curl_share_cleanup(loop->share);
+        }
+        delete loop;
+    }
+}
+
+int EventLoops::Loops() const {
+    return (int)loops.size();
+}
+
+void EventLoops::Add(CURL* curl, unsigned int key) {
+    EventLoop* loop = loops[key % loops.size()];
+    bool full;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        loop->queue.push_back(curl);
+        full = loop->running >= loop->capacity;
+    }
+    curl_multi_wakeup(loop->multi);
+    //the shard's loop is busy, whichever loop has room may steal it
+    for (size_t i = 0; full && loops.size() > 1 && i < loops.size(); i++) {
+        if (loops[i] != loop) {
+            curl_multi_wakeup(loops[i]->multi);
+        }
+    }
+}
+
+void EventLoops::Resume(CURL* curl) {
+    //only the thread driving the handle may unpause it
+    std::lock_guard<std::mutex> guard(lock);
+    auto o = owner.find(curl);
+    if (o != owner.end()) {
+        o->second->resume.push_back(curl);
+        curl_multi_wakeup(o->second->multi);
+    }
+}
+
+//moves the transfers the loop has room for out of its queue, then out of
+//the longest queue of the others. Called with the lock held
+void EventLoops::Take(EventLoop* loop, std::vector<CURL*>& taken) {
+    int room = loop->capacity - loop->running;
+    while (room > 0 && !loop->queue.empty()) {
+        taken.push_back(loop->queue.front());
+        loop->queue.pop_front();
+        room--;
+    }
+    while (room > 0) {
+        EventLoop* busiest = NULL;
+        for (EventLoop* other : loops) {
+            if (other != loop && !other->queue.empty() && (!busiest || other->queue.size() > busiest->queue.size())) {
+                busiest = other;
+            }
+        }
+        if (!busiest) {
+            break;
+        }
+        //the newest job of the victim, its oldest ones start there first
+        taken.push_back(busiest->queue.back());
+        busiest->queue.pop_back();
+        room--;
+    }
+    for (CURL* curl : taken) {
+        owner[curl] = loop;
+    }
+    loop->running += (int)taken.size();
+}
+
+//one round of the loop: start what it may, run the transfers and wait up
+//to the timeout for activity when none finished
+void EventLoops::Drive(EventLoop* loop, std::vector<LoopDone>& out, int timeout) {
+    std::vector<CURL*> taken;
+    std::vector<CURL*> resume;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Take(loop, taken);
+        resume.swap(loop->resume);
+    }
+    for (CURL* curl : taken) {
+        if (loop->share) {
+            curl_easy_setopt(curl, CURLOPT_SHARE, loop->share);
+        }
+        curl_multi_add_handle(loop->multi, curl);
+    }
+    //an unpaused transfer only picks its socket up again in the next
+    //perform, this round doesn't wait for activity
+    for (CURL* curl : resume) {
+        curl_easy_pause(curl, CURLPAUSE_CONT);
+        timeout = 0;
+    }
+    std::vector<LoopDone> ended;
+    for (int round = 0; round < 2; round++) {
+        int stillRunning = 0;
+        curl_multi_perform(loop->multi, &stillRunning);
+        int queued = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(loop->multi, &queued))) {
+            if (msg->msg == CURLMSG_DONE) {
+                LoopDone d = { msg->easy_handle, msg->data.result };
+                curl_multi_remove_handle(loop->multi, d.curl);
+                ended.push_back(d);
+            }
+        }
+        if (!ended.empty() || round == 1 || timeout <= 0 || stop) {
+            break;
+        }
+        curl_multi_poll(loop->multi, NULL, 0, timeout, NULL);
+    }
+    if (ended.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (LoopDone& d : ended) {
+            owner.erase(d.curl);
+            out.push_back(d);
+        }
+        loop->running -= (int)ended.size();
+    }
+    finished.notify_one();
+}
+
+void EventLoops::Wake() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        woken = true;
+    }
+    finished.notify_one();
+}
+
+void EventLoops::Run(EventLoop* loop) {
+    while (!stop) {
+        Drive(loop, done, 1000);
+    }
+}
+
+void EventLoops::Wait(std::vector<LoopDone>& out, int timeout) {
+    if (loops.size() == 1) {
+        Drive(loops[0], out, timeout);
+        return;
+    }
+    std::unique_lock<std::mutex> guard(lock);
+    if (done.empty() && !woken && timeout > 0) {
+        finished.wait_for(guard, std::chrono::milliseconds(timeout), [this]() { return !done.empty() || woken; });
+    }
+    woken = false;
+    out.insert(out.end(), done.begin(), done.end());
+    done.clear();
+}
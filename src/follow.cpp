@@ -0,0 +1,223 @@
+#include <follow.hpp>
+#include <util.hpp>
+#include <handlepool.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+struct FollowPoll {
+    std::string path = "";
+    FILE* file = NULL;
+    bool truncated = false;
+    long status = 0;
+    std::string etag = "";
+    std::string lastModified = "";
+    //total size from Content-Range, -1 if not sent
+    curl_off_t total = -1;
+    curl_off_t appended = 0;
+    bool writeError = false;
+};
+
+static size_t FollowHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    FollowPoll* p = (FollowPoll*)ptr;
+    std::string line(buffer, size * nitems);
+    std::string lower = line;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (lower.compare(0, 5, "http/") == 0) {
+        p->status = atol(line.c_str() + line.find(' '));
+        p->etag = "";
+        p->lastModified = "";
+        p->total = -1;
+    }
+    else if (lower.compare(0, 5, "etag:") == 0) {
+        p->etag = line.substr(5);
+        p->etag.erase(0, p->etag.find_first_not_of(" "));
+        p->etag.erase(p->etag.find_last_not_of(" \r\n") + 1);
+    }
+    else if (lower.compare(0, 14, "last-modified:") == 0) {
+        p->lastModified = line.substr(14);
+        p->lastModified.erase(0, p->lastModified.find_first_not_of(" "));
+        p->lastModified.erase(p->lastModified.find_last_not_of(" \r\n") + 1);
+    }
+    else if (lower.compare(0, 14, "content-range:") == 0) {
+        size_t slash = lower.find('/');
+        if (slash != std::string::npos && lower[slash + 1] != '*') {
+            p->total = strtoll(lower.c_str() + slash + 1, NULL, 10);
+        }
+        else if (slash != std::string::npos) {
+            p->total = -1;
+        }
+        //"bytes */total" of a 416
+        size_t star = lower.find("*/");
+        if (star != std::string::npos) {
+            p->total = strtoll(lower.c_str() + star + 2, NULL, 10);
+        }
+    }
+    return size * nitems;
+}
+
+static size_t FollowWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    FollowPoll* p = (FollowPoll*)ptr;
+    size_t len = size * nmemb;
+    if (p->status != 200 && p->status != 206) {
+        return len;
+    }
+    if (p->status == 200 && !p->truncated) {
+        //the whole file is coming, drop what we have
+        p->file = freopen(p->path.c_str(), "wb", p->file);
+        p->truncated = true;
+        if (!p->file) {
+            p->writeError = true;
+            return 0;
+        }
+    }
+    if (fwrite(data, 1, len, p->file) != len) {
+        p->writeError = true;
+        return 0;
+    }
+    p->appended += len;
+    return len;
+}
+
+static curl_off_t LocalSize(std::string path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    curl_off_t size = TellFile(f);
+    fclose(f);
+    return size < 0 ? 0 : size;
+}
+
+bool FollowFile(std::string url, std::string output, FollowOptions opts) {
+    CURL* curl = Handles().Acquire();
+    if (!curl) {
+        return false;
+    }
+    //pick up where an earlier run left off
+    curl_off_t offset = LocalSize(output);
+    std::string etag = "";
+    std::string lastModified = "";
+    //the server answered a range request with the whole file, it is only
+    //fetched again when its validators say it changed
+    bool rangeless = false;
+    double interval = opts.minInterval;
+    bool ok = true;
+    while (true) {
+        FollowPoll poll;
+        poll.path = output;
+        //a 200 replaces the file, anything else appends to it
+        poll.file = fopen(output.c_str(), "ab");
+        if (!poll.file) {
+            std::cout << "error while opening file" << std::endl;
+            ok = false;
+            break;
+        }
+        struct curl_slist* headers = NULL;
+        if (rangeless) {
+            if (etag != "") {
+                headers = curl_slist_append(headers, ("If-None-Match: " + etag).c_str());
+            }
+            if (lastModified != "") {
+                headers = curl_slist_append(headers, ("If-Modified-Since: " + lastModified).c_str());
+            }
+        }
+        else if (etag != "") {
+            //if the file changed identity the server answers 200 with all of it
+            headers = curl_slist_append(headers, ("If-Range: " + etag).c_str());
+        }
+        curl_easy_reset(curl);
+        Sessions().Attach(curl);
+        Network().Apply(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        curl_easy_setopt(curl, CURLOPT_RANGE, (std::to_string(offset) + "-").c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, FollowHeader);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &poll);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, FollowWrite);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &poll);
+        CURLcode code = curl_easy_perform(curl);
+        if (poll.file && poll.status == 200 && !poll.truncated && !poll.writeError) {
+            //an empty body replaces the file too
+            poll.file = freopen(output.c_str(), "wb", poll.file);
+        }
+        if (poll.file) {
+            fclose(poll.file);
+        }
+        curl_slist_free_all(headers);
+
+        bool changed = false;
+        if (poll.writeError) {
+            std::cout << "error while writing file" << std::endl;
+            ok = false;
+            break;
+        }
+        if (code != CURLE_OK && poll.status == 0) {
+            std::cout << "poll failed: " << curl_easy_strerror(code) << std::endl;
+        }
+        else if (poll.status == 206) {
+            if (etag != "" && poll.etag != "" && poll.etag != etag) {
+                //no If-Range support and a new entity: fetch it from the start
+                std::cout << "remote file replaced, downloading it again" << std::endl;
+                fclose(fopen(output.c_str(), "wb"));
+                offset = 0;
+                etag = "";
+                continue;
+            }
+            offset += poll.appended;
+            changed = poll.appended > 0;
+        }
+        else if (poll.status == 416) {
+            if (poll.total >= 0 && poll.total < offset) {
+                std::cout << "remote file truncated, downloading it again" << std::endl;
+                fclose(fopen(output.c_str(), "wb"));
+                offset = 0;
+                etag = "";
+                continue;
+            }
+        }
+        else if (poll.status == 200) {
+            //same length and validators as the last poll: nothing happened to the file
+            bool same = poll.appended == offset && poll.etag == etag && poll.lastModified == lastModified;
+            if (offset > 0 && same) {
+                rangeless = true;
+            }
+            else if (offset > 0) {
+                //If-Range failed or the server has no range support
+                std::cout << "remote file replaced, downloaded it again" << std::endl;
+            }
+            offset = poll.appended;
+            changed = !same;
+        }
+        else if (poll.status == 304) {
+            //unchanged since the last poll of a server without ranges
+        }
+        else {
+            std::cout << "poll failed: HTTP " << poll.status << std::endl;
+        }
+        if (poll.etag != "") {
+            etag = poll.etag;
+        }
+        if (poll.lastModified != "") {
+            lastModified = poll.lastModified;
+        }
+        if (changed && opts.verbose) {
+            std::cout << "+" << (poll.status == 200 ? offset : poll.appended) << " bytes, " << offset << " total" << std::endl;
+        }
+
+        //poll quickly while the file grows, back off while it doesn't
+        interval = changed ? opts.minInterval : std::min(interval * 2, opts.maxInterval);
+        std::this_thread::sleep_for(std::chrono::milliseconds((long)(interval * 1000)));
+    }
+    Network().Record(curl);
+    Handles().Release(curl);
+    return ok;
+}
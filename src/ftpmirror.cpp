@@ -0,0 +1,384 @@
+#include <ftpmirror.hpp>
+#include <util.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <iostream>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+struct FtpEntry {
+    std::string url;
+    std::string path;
+    bool dir = false;
+    //came from an NLST listing, so it may still turn out to be a directory
+    bool untyped = false;
+    curl_off_t size = -1;
+    time_t mtime = -1;
+    int depth = 0;
+    int attempts = 0;
+};
+
+struct FtpTransfer {
+    FtpEntry entry;
+    bool mlsd = false;
+    std::string listing = "";
+    //files are written next to their final name and renamed when complete
+    std::string partPath = "";
+    FILE* file = NULL;
+    bool writeError = false;
+    curl_off_t received = 0;
+};
+
+static size_t ListingWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    FtpTransfer* t = (FtpTransfer*)ptr;
+    t->listing.append(data, size * nmemb);
+    return size * nmemb;
+}
+
+static size_t FileWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    FtpTransfer* t = (FtpTransfer*)ptr;
+    size_t len = size * nmemb;
+    if (!t->file) {
+        //opened on the first data only, a directory or an unchanged file leaves nothing behind
+        MakeParentDirs(t->partPath);
+        t->file = fopen(t->partPath.c_str(), "wb");
+        if (!t->file) {
+            t->writeError = true;
+            return 0;
+        }
+    }
+    if (fwrite(data, 1, len, t->file) != len) {
+        t->writeError = true;
+        return 0;
+    }
+    t->received += len;
+    return len;
+}
+
+//MLSD times are UTC, YYYYMMDDHHMMSS with optional fractions
+static time_t ParseMlsdTime(std::string value) {
+    if (value.size() < 14) {
+        return -1;
+    }
+    struct tm t = {};
+    t.tm_year = atoi(value.substr(0, 4).c_str()) - 1900;
+    t.tm_mon = atoi(value.substr(4, 2).c_str()) - 1;
+    t.tm_mday = atoi(value.substr(6, 2).c_str());
+    t.tm_hour = atoi(value.substr(8, 2).c_str());
+    t.tm_min = atoi(value.substr(10, 2).c_str());
+    t.tm_sec = atoi(value.substr(12, 2).c_str());
+#ifdef __linux__
+    return timegm(&t);
+#else
+    return _mkgmtime(&t);
+#endif
+}
+
+//"type=file;size=123;modify=20240101120000; name", false for entries that aren't files or directories
+static bool ParseMlsdLine(std::string line, FtpEntry& e, std::string& name) {
+    size_t space = line.find(' ');
+    if (space == std::string::npos) {
+        return false;
+    }
+    name = line.substr(space + 1);
+    std::string facts = line.substr(0, space);
+    std::string type = "";
+    size_t pos = 0;
+    while (pos < facts.size()) {
+        size_t end = facts.find(';', pos);
+        if (end == std::string::npos) {
+            end = facts.size();
+        }
+        std::string fact = facts.substr(pos, end - pos);
+        std::transform(fact.begin(), fact.end(), fact.begin(), ::tolower);
+        size_t eq = fact.find('=');
+        if (eq != std::string::npos) {
+            std::string key = fact.substr(0, eq);
+            std::string value = fact.substr(eq + 1);
+            if (key == "type") {
+                type = value;
+            }
+            else if (key == "size") {
+                e.size = strtoll(value.c_str(), NULL, 10);
+            }
+            else if (key == "modify") {
+                e.mtime = ParseMlsdTime(value);
+            }
+        }
+        pos = end + 1;
+    }
+    if (type == "dir") {
+        e.dir = true;
+        return true;
+    }
+    return type == "file";
+}
+
+//outputDir/host/path of the start url, without credentials and url escapes
+static std::string RootPath(CURL* curl, std::string dir, std::string url) {
+    std::string rest = url.substr(url.find("://") + 3);
+    size_t at = rest.find('@');
+    if (at != std::string::npos && at < rest.find('/')) {
+        rest = rest.substr(at + 1);
+    }
+    int len = 0;
+    char* plain = curl_easy_unescape(curl, rest.c_str(), (int)rest.size(), &len);
+    rest = std::string(plain, len);
+    curl_free(plain);
+    return JoinPath(dir, rest);
+}
+
+static void QueueListing(CURL* curl, FtpTransfer* t, FtpMirrorOptions& opts, std::deque<FtpEntry>& dirs, std::deque<FtpEntry>& files) {
+    std::istringstream lines(t->listing);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line != "" && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        FtpEntry e;
+        std::string name;
+        if (t->mlsd) {
+            if (!ParseMlsdLine(line, e, name)) {
+                continue;
+            }
+        }
+        else {
+            //some servers answer NLST with paths
+            name = line.substr(line.find_last_of('/') + 1);
+            e.untyped = true;
+        }
+        std::string trimmed = name;
+        trimmed.erase(0, trimmed.find_first_not_of(' '));
+        if (trimmed == "" || trimmed == "." || trimmed == ".." || name.find_first_of("/\\") != std::string::npos) {
+            continue;
+        }
+        char* escaped = curl_easy_escape(curl, name.c_str(), (int)name.size());
+        e.url = t->entry.url + escaped + (e.dir ? "/" : "");
+        curl_free(escaped);
+        e.path = JoinPath(t->entry.path, name);
+        e.depth = t->entry.depth + 1;
+        if (!e.dir) {
+            files.push_back(e);
+        }
+        else if (e.depth <= opts.maxDepth) {
+            dirs.push_back(e);
+        }
+    }
+}
+
+//the local copy has the size and time the listing reported
+static bool Unchanged(FtpEntry& e) {
+    curl_off_t size;
+    time_t mtime;
+    if (e.untyped || e.size < 0 || e.mtime < 0 || !StatFile(e.path, size, mtime)) {
+        return false;
+    }
+    return size == e.size && mtime == e.mtime;
+}
+
+static void SetupTransfer(CURL* curl, FtpTransfer* t, bool mlsd) {
+    curl_easy_reset(curl);
+    Sessions().Attach(curl);
+    Network().Apply(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, t->entry.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    //one CWD per transfer instead of one per path component
+    curl_easy_setopt(curl, CURLOPT_FTP_FILEMETHOD, (long)CURLFTPMETHOD_SINGLECWD);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, t);
+    if (t->entry.dir) {
+        t->mlsd = mlsd;
+        if (mlsd) {
+            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "MLSD");
+        }
+        else {
+            curl_easy_setopt(curl, CURLOPT_DIRLISTONLY, 1L);
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ListingWrite);
+        return;
+    }
+    t->partPath = t->entry.path + ".part";
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, FileWrite);
+    if (t->entry.mtime < 0) {
+        //no time from the listing, ask for it (MDTM)
+        curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    }
+    curl_off_t size;
+    time_t mtime;
+    if (t->entry.untyped && StatFile(t->entry.path, size, mtime)) {
+        //NLST gave no size or time, let the server skip files not newer than ours
+        curl_easy_setopt(curl, CURLOPT_TIMECONDITION, (long)CURL_TIMECOND_IFMODSINCE);
+        curl_easy_setopt(curl, CURLOPT_TIMEVALUE_LARGE, (curl_off_t)mtime);
+    }
+}
+
+//moves the completed download in place and gives it the remote time
+static bool FinishFile(CURL* curl, FtpTransfer* t) {
+    if (!t->file) {
+        //empty file, nothing was written
+        MakeParentDirs(t->partPath);
+        t->file = fopen(t->partPath.c_str(), "wb");
+        if (!t->file) {
+            return false;
+        }
+    }
+    fclose(t->file);
+    t->file = NULL;
+    remove(t->entry.path.c_str());
+    if (rename(t->partPath.c_str(), t->entry.path.c_str()) != 0) {
+        return false;
+    }
+    curl_off_t filetime = -1;
+    curl_easy_getinfo(curl, CURLINFO_FILETIME_T, &filetime);
+    time_t mtime = t->entry.mtime >= 0 ? t->entry.mtime : (time_t)filetime;
+    if (mtime >= 0) {
+        SetFileTime(t->entry.path, mtime);
+    }
+    return true;
+}
+
+bool MirrorFtp(std::string url, FtpMirrorOptions opts, FtpMirrorStats& stats) {
+    if (url[url.size() - 1] != '/') {
+        url += "/";
+    }
+    CURLM* multi = curl_multi_init();
+    //the control connections are kept in the multi handle's cache and shared by every transfer
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)opts.connections);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)opts.connections);
+    std::vector<CURL*> idle;
+    idle.push_back(curl_easy_init());
+
+    FtpEntry root;
+    root.url = url;
+    root.dir = true;
+    root.path = RootPath(idle.back(), opts.outputDir, url);
+    std::deque<FtpEntry> dirs;
+    std::deque<FtpEntry> files;
+    dirs.push_back(root);
+    bool mlsd = true;
+    int running = 0;
+
+    while (!dirs.empty() || !files.empty() || running > 0) {
+        while (running < opts.connections && (!dirs.empty() || !files.empty())) {
+            FtpTransfer* t = new FtpTransfer();
+            //listings first, they are what discovers the rest of the work
+            if (!dirs.empty()) {
+                t->entry = dirs.front();
+                dirs.pop_front();
+            }
+            else {
+                t->entry = files.front();
+                files.pop_front();
+                if (Unchanged(t->entry)) {
+                    stats.skipped++;
+                    delete t;
+                    continue;
+                }
+            }
+            CURL* curl;
+            if (idle.empty()) {
+                curl = curl_easy_init();
+            }
+            else {
+                curl = idle.back();
+                idle.pop_back();
+            }
+            SetupTransfer(curl, t, mlsd);
+            curl_multi_add_handle(multi, curl);
+            running++;
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int msgs = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &msgs))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL* curl = msg->easy_handle;
+            FtpTransfer* t = NULL;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&t);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi, curl);
+            running--;
+            FtpEntry& e = t->entry;
+
+            if (e.dir) {
+                if (code == CURLE_OK) {
+                    stats.dirs++;
+                    QueueListing(curl, t, opts, dirs, files);
+                    if (opts.verbose) {
+                        std::cout << "listed " << e.url << std::endl;
+                    }
+                }
+                else if (t->mlsd && mlsd && code == CURLE_FTP_COULDNT_RETR_FILE) {
+                    //MLSD was refused, list names only from now on
+                    mlsd = false;
+                    dirs.push_front(e);
+                    if (opts.verbose) {
+                        std::cout << "no MLSD support, using NLST" << std::endl;
+                    }
+                }
+                else if (++e.attempts < opts.maxAttempts) {
+                    dirs.push_back(e);
+                }
+                else {
+                    stats.failed++;
+                    std::cout << "listing " << e.url << " failed: " << curl_easy_strerror(code) << std::endl;
+                }
+            }
+            else {
+                long unmet = 0;
+                curl_easy_getinfo(curl, CURLINFO_CONDITION_UNMET, &unmet);
+                if (code == CURLE_OK && unmet) {
+                    stats.skipped++;
+                }
+                else if (code == CURLE_OK && !t->writeError && FinishFile(curl, t)) {
+                    stats.files++;
+                    stats.bytes += t->received;
+                    if (opts.verbose) {
+                        std::cout << e.path << " (" << t->received << " bytes)" << std::endl;
+                    }
+                }
+                else if (e.untyped && code == CURLE_REMOTE_FILE_NOT_FOUND) {
+                    //a name from NLST that can't be retrieved is most likely a directory
+                    e.untyped = false;
+                    e.dir = true;
+                    e.url += "/";
+                    if (e.depth <= opts.maxDepth) {
+                        dirs.push_back(e);
+                    }
+                }
+                else if (++e.attempts < opts.maxAttempts) {
+                    files.push_back(e);
+                }
+                else {
+                    stats.failed++;
+                    std::cout << e.url << " failed: " << (t->writeError ? "error while writing file" : curl_easy_strerror(code)) << std::endl;
+                }
+                if (t->file) {
+                    fclose(t->file);
+                }
+                if (t->partPath != "") {
+                    remove(t->partPath.c_str());
+                }
+            }
+            idle.push_back(curl);
+            delete t;
+        }
+        if (running > 0) {
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+    }
+
+    for (CURL* curl : idle) {
+        curl_easy_cleanup(curl);
+    }
+    curl_multi_cleanup(multi);
+    return stats.failed == 0;
+}
@@ -0,0 +1,86 @@
+#include <handlepool.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+
+HandlePool::HandlePool() : bufferSize(64 * 1024), maxIdle(1024), created(0), reused(0) {}
+
+HandlePool::~HandlePool() {
+    Clear();
+}
+
+void HandlePool::SetBufferSize(long bytes) {
+    std::lock_guard<std::mutex> guard(lock);
+    bufferSize = bytes;
+}
+
+CURL* HandlePool::Acquire() {
+    CURL* curl = NULL;
+    long size;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!idle.empty()) {
+            curl = idle.back();
+            idle.pop_back();
+            reused++;
+        }
+        else {
+            created++;
+        }
+        size = bufferSize;
+    }
+    if (!curl && !(curl = curl_easy_init())) {
+        return NULL;
+    }
+    if (size > 0) {
+        curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, size);
+    }
+    Sessions().Attach(curl);
+    Network().Apply(curl);
+    return curl;
+}
+
+void HandlePool::Release(CURL* curl) {
+    //keeps the handle's DNS cache, the options go back to their defaults
+    curl_easy_reset(curl);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (idle.size() < maxIdle) {
+            idle.push_back(curl);
+            return;
+        }
+    }
+    curl_easy_cleanup(curl);
+}
+
+void HandlePool::Clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (CURL* curl : idle) {
+        curl_easy_cleanup(curl);
+    }
+    idle.clear();
+}
+
+long long HandlePool::Created() {
+    std::lock_guard<std::mutex> guard(lock);
+    return created;
+}
+
+long long HandlePool::Reused() {
+    std::lock_guard<std::mutex> guard(lock);
+    return reused;
+}
+
+HandlePool& Handles() {
+    static HandlePool pool;
+    return pool;
+}
+
+CurlGlobal::CurlGlobal() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+CurlGlobal::~CurlGlobal() {
+    Handles().Clear();
+    Sessions().Close();
+    curl_global_cleanup();
+}
@@ -0,0 +1,100 @@
+#include <hosthealth.hpp>
+#include <cmath>
+
+HealthTracker::HealthTracker(int _failureThreshold, double _probeInterval, double _maxProbeInterval) : rng(std::random_device{}()) {
+    failureThreshold = _failureThreshold;
+    probeInterval = _probeInterval;
+    maxProbeInterval = _maxProbeInterval;
+}
+
+void HealthTracker::Trip(HostHealth& h, double now) {
+    h.state = BreakerState::Open;
+    h.trips++;
+    h.totalTrips++;
+    //each consecutive trip waits twice as long before probing again
+    double wait = probeInterval * pow(2.0, h.trips - 1);
+    if (wait > maxProbeInterval) {
+        wait = maxProbeInterval;
+    }
+    h.nextProbe = now + wait;
+}
+
+bool HealthTracker::CanDispatch(std::string host, double now) {
+    HostHealth& h = hosts[host];
+    if (h.state == BreakerState::Closed) {
+        return true;
+    }
+    if (h.state == BreakerState::Open && now >= h.nextProbe) {
+        h.state = BreakerState::HalfOpen;
+    }
+    if (h.state == BreakerState::HalfOpen && !h.probeInFlight) {
+        h.probeInFlight = true;
+        return true;
+    }
+    return false;
+}
+
+void HealthTracker::OnSuccess(std::string host, double latency) {
+    HostHealth& h = hosts[host];
+    h.successes++;
+    h.consecutiveFailures = 0;
+    h.avgLatency = (h.successes == 1) ? latency : h.avgLatency * 0.8 + latency * 0.2;
+    if (h.state != BreakerState::Closed) {
+        h.state = BreakerState::Closed;
+        h.trips = 0;
+    }
+    h.probeInFlight = false;
+}
+
+void HealthTracker::OnFailure(std::string host, bool timeout, double now) {
+    HostHealth& h = hosts[host];
+    h.failures++;
+    h.consecutiveFailures++;
+    if (timeout) {
+        h.timeouts++;
+    }
+    if (h.state == BreakerState::HalfOpen) {
+        //the probe failed, go back to waiting
+        h.probeInFlight = false;
+        Trip(h, now);
+    }
+    else if (h.state == BreakerState::Closed && h.consecutiveFailures >= failureThreshold) {
+        Trip(h, now);
+    }
+}
+
+bool HealthTracker::IsOpen(std::string host) {
+    return hosts[host].state != BreakerState::Closed;
+}
+
+double HealthTracker::NextProbe(std::string host) {
+    HostHealth& h = hosts[host];
+    if (h.state == BreakerState::HalfOpen) {
+        //a probe is already out, wait for its outcome
+        return 1e18;
+    }
+    return h.nextProbe;
+}
+
+void HealthTracker::CancelProbe(std::string host, double now) {
+    HostHealth& h = hosts[host];
+    h.probeInFlight = false;
+    if (h.state == BreakerState::HalfOpen) {
+        //nothing was learned, the next job may probe right away
+        h.state = BreakerState::Open;
+        h.nextProbe = now;
+    }
+}
+
+double HealthTracker::Backoff(int attempt, double base, double cap) {
+    double ceiling = base * pow(2.0, attempt);
+    if (ceiling > cap) {
+        ceiling = cap;
+    }
+    std::uniform_real_distribution<double> dist(0.0, ceiling);
+    return dist(rng);
+}
+
+const std::map<std::string, HostHealth>& HealthTracker::Hosts() {
+    return hosts;
+}
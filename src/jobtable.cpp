@@ -0,0 +1,160 @@
+#include <jobtable.hpp>
+#include <cstring>
+
+static const uint8_t stateMask = 0x3f;
+static const uint8_t resumeFlag = 0x40;
+static const uint8_t rangesFlag = 0x80;
+
+uint32_t HostTable::Intern(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    uint32_t id = (uint32_t)names.size();
+    ids[name] = id;
+    names.push_back(name);
+    return id;
+}
+
+const std::string& HostTable::Name(uint32_t id) const {
+    return names[id];
+}
+
+size_t HostTable::Size() const {
+    return names.size();
+}
+
+JobTable::JobTable() : garbage(0) {}
+
+uint32_t JobTable::Store(const std::string& s) {
+    uint32_t offset = (uint32_t)pool.size();
+    pool.insert(pool.end(), s.c_str(), s.c_str() + s.size() + 1);
+    return offset;
+}
+
+uint32_t JobTable::Add(const BatchJob& job) {
+    uint32_t row;
+    if (!freeRows.empty()) {
+        row = freeRows.back();
+        freeRows.pop_back();
+    }
+    else {
+        row = (uint32_t)urls.size();
+        urls.push_back(0);
+        outputs.push_back(0);
+        hostIds.push_back(0);
+        indexes.push_back(0);
+        flags.push_back(0);
+        attemptCounts.push_back(0);
+        sizes.push_back(-1);
+        rangeStarts.push_back(-1);
+        rangeEnds.push_back(-1);
+        notBefores.push_back(0);
+    }
+    urls[row] = Store(job.url);
+    outputs[row] = Store(job.output);
+    hostIds[row] = hosts.Intern(job.host);
+    indexes[row] = (uint32_t)job.index;
+    flags[row] = (uint8_t)JobState::Ready | (job.ranges ? rangesFlag : 0) | (job.resume ? resumeFlag : 0);
+    attemptCounts[row] = (uint8_t)(job.attempts > 255 ? 255 : job.attempts);
+    sizes[row] = job.size;
+    rangeStarts[row] = job.rangeStart;
+    rangeEnds[row] = job.rangeEnd;
+    notBefores[row] = job.notBefore;
+    return row;
+}
+
+void JobTable::Release(uint32_t row) {
+    garbage += strlen(&pool[urls[row]]) + 1 + strlen(&pool[outputs[row]]) + 1;
+    flags[row] = (uint8_t)JobState::Free;
+    freeRows.push_back(row);
+    //rewrite the arena once most of it belongs to released rows
+    if (pool.size() > 1024 * 1024 && garbage > pool.size() / 2) {
+        Compact();
+    }
+}
+
+void JobTable::Compact() {
+    std::vector<char> old;
+    old.swap(pool);
+    pool.reserve(old.size() - garbage);
+    for (size_t row = 0; row < urls.size(); row++) {
+        if (State((uint32_t)row) != JobState::Free) {
+            urls[row] = Store(&old[urls[row]]);
+            outputs[row] = Store(&old[outputs[row]]);
+        }
+    }
+    garbage = 0;
+}
+
+const char* JobTable::Url(uint32_t row) const {
+    return &pool[urls[row]];
+}
+
+const char* JobTable::Output(uint32_t row) const {
+    return &pool[outputs[row]];
+}
+
+uint32_t JobTable::Host(uint32_t row) const {
+    return hostIds[row];
+}
+
+uint32_t JobTable::Index(uint32_t row) const {
+    return indexes[row];
+}
+
+JobState JobTable::State(uint32_t row) const {
+    return (JobState)(flags[row] & stateMask);
+}
+
+void JobTable::SetState(uint32_t row, JobState state) {
+    flags[row] = (flags[row] & ~stateMask) | (uint8_t)state;
+}
+
+bool JobTable::Ranges(uint32_t row) const {
+    return (flags[row] & rangesFlag) != 0;
+}
+
+bool JobTable::Resume(uint32_t row) const {
+    return (flags[row] & resumeFlag) != 0;
+}
+
+void JobTable::SetResume(uint32_t row, bool resume) {
+    flags[row] = resume ? (flags[row] | resumeFlag) : (flags[row] & ~resumeFlag);
+}
+
+int JobTable::AddAttempt(uint32_t row) {
+    if (attemptCounts[row] < 255) {
+        attemptCounts[row]++;
+    }
+    return attemptCounts[row];
+}
+
+curl_off_t JobTable::Size(uint32_t row) const {
+    return sizes[row];
+}
+
+curl_off_t JobTable::RangeStart(uint32_t row) const {
+    return rangeStarts[row];
+}
+
+curl_off_t JobTable::RangeEnd(uint32_t row) const {
+    return rangeEnds[row];
+}
+
+double JobTable::NotBefore(uint32_t row) const {
+    return notBefores[row];
+}
+
+void JobTable::SetNotBefore(uint32_t row, double when) {
+    notBefores[row] = when;
+}
+
+size_t JobTable::Live() const {
+    return urls.size() - freeRows.size();
+}
+
+size_t JobTable::MemoryBytes() const {
+    size_t perRow = sizeof(uint32_t) * 4 + sizeof(uint8_t) * 2 + sizeof(curl_off_t) * 3 + sizeof(double);
+    return pool.capacity() + urls.capacity() * perRow + freeRows.capacity() * sizeof(uint32_t);
+}
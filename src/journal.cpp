@@ -0,0 +1,215 @@
+#include <journal.hpp>
+#include <cstring>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#else
+#include <io.h>
+#include <windows.h>
+#endif
+
+static const char magic[8] = { 'D', 'L', 'J', 'R', 'N', 'L', '1', '\n' };
+//crc32, list position, job key, type, 3 bytes padding
+static const size_t recordSize = 16;
+enum : uint8_t { JobNone = 0, JobStarted = 1, JobDone = 2 };
+
+static uint32_t Checksum(const unsigned char* data, size_t len) {
+#ifdef HAVE_ZLIB
+    return (uint32_t)crc32(crc32(0L, Z_NULL, 0), data, (uInt)len);
+#else
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+#endif
+}
+
+static void Put32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t Get32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void Encode(std::string& out, uint8_t type, uint32_t index, uint32_t key) {
+    unsigned char rec[recordSize] = { 0 };
+    Put32(rec + 4, index);
+    Put32(rec + 8, key);
+    rec[12] = type;
+    Put32(rec, Checksum(rec + 4, recordSize - 4));
+    out.append((const char*)rec, recordSize);
+}
+
+static bool SyncFile(FILE* file) {
+    if (fflush(file) != 0) {
+        return false;
+    }
+#ifdef __linux__
+    return fsync(fileno(file)) == 0;
+#else
+    return _commit(_fileno(file)) == 0;
+#endif
+}
+
+Journal::Journal() : file(NULL), lastCommit(0), records(0), live(0), replayed(0) {}
+
+Journal::~Journal() {
+    if (file) {
+        Commit(0, true);
+        fclose(file);
+    }
+}
+
+void Journal::Apply(uint8_t type, uint32_t index, uint32_t key) {
+    if (index >= states.size()) {
+        states.resize((size_t)index + 1, JobNone);
+        keys.resize((size_t)index + 1, 0);
+    }
+    if (states[index] == JobNone) {
+        live++;
+    }
+    states[index] = type;
+    keys[index] = key;
+}
+
+bool Journal::Open(std::string p) {
+    path = p;
+    bool torn = false;
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in) {
+        char head[sizeof(magic)];
+        if (fread(head, 1, sizeof(magic), in) == sizeof(magic) && memcmp(head, magic, sizeof(magic)) == 0) {
+            unsigned char rec[recordSize];
+            size_t got;
+            while ((got = fread(rec, 1, recordSize, in)) == recordSize) {
+                if (Get32(rec) != Checksum(rec + 4, recordSize - 4) || rec[12] == JobNone || rec[12] > JobDone) {
+                    torn = true;
+                    break;
+                }
+                Apply(rec[12], Get32(rec + 4), Get32(rec + 8));
+                replayed++;
+            }
+            torn = torn || got > 0;
+        }
+        else {
+            torn = true;
+        }
+        fclose(in);
+        records = replayed;
+        //rewriting drops the bad tail, appending after it would hide every later record
+        if (torn || records > live + live / 2 + 65536) {
+            return Compact();
+        }
+        file = fopen(path.c_str(), "ab");
+        return file != NULL;
+    }
+    return Compact();
+}
+
+//writes the live state to a new journal and moves it over the old one
+bool Journal::Compact() {
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    std::string temp = path + ".tmp";
+    FILE* out = fopen(temp.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    std::string data(magic, sizeof(magic));
+    for (size_t i = 0; i < states.size(); i++) {
+        if (states[i] != JobNone) {
+            Encode(data, states[i], (uint32_t)i, keys[i]);
+        }
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), out) == data.size() && SyncFile(out);
+    fclose(out);
+#ifdef __linux__
+    ok = ok && rename(temp.c_str(), path.c_str()) == 0;
+#else
+    ok = ok && MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#endif
+    if (!ok) {
+        remove(temp.c_str());
+        return false;
+    }
+    records = live;
+    file = fopen(path.c_str(), "ab");
+    return file != NULL;
+}
+
+void Journal::Record(uint8_t type, uint32_t index, uint32_t key) {
+    Apply(type, index, key);
+    if (!file) {
+        return;
+    }
+    Encode(buffer, type, index, key);
+    records++;
+}
+
+bool Journal::IsDone(uint32_t index, uint32_t key) const {
+    return index < states.size() && states[index] == JobDone && keys[index] == key;
+}
+
+bool Journal::WasStarted(uint32_t index, uint32_t key) const {
+    return index < states.size() && states[index] == JobStarted && keys[index] == key;
+}
+
+void Journal::Started(uint32_t index, uint32_t key) {
+    Record(JobStarted, index, key);
+}
+
+void Journal::Finished(uint32_t index, uint32_t key) {
+    Record(JobDone, index, key);
+}
+
+bool Journal::Commit(double now, bool force) {
+    if (!file || buffer.empty()) {
+        return true;
+    }
+    //group commit: one write and one fsync for everything since the last one
+    if (!force && now - lastCommit < 0.1 && buffer.size() < 1024 * 1024) {
+        return true;
+    }
+    bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() && SyncFile(file);
+    buffer.clear();
+    lastCommit = now;
+    if (!ok) {
+        //a torn group is cut off at the next open, with every record appended
+        //after it; stop here so a resume redoes these jobs instead
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    if (records > live + live / 2 + 65536) {
+        return Compact();
+    }
+    return true;
+}
+
+long long Journal::Replayed() const {
+    return replayed;
+}
+
+uint32_t Journal::KeyOf(const char* url, const char* output) {
+    uint32_t hash = 2166136261u;
+    for (const char* p = url; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    hash = (hash ^ '\n') * 16777619u;
+    for (const char* p = output; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,106 @@
+#include <listreader.hpp>
+#include <iostream>
+#include <cstring>
+
+ListReader::ListReader() : file(NULL), buffer(1024 * 1024), pos(0), end(0), eof(false), lines(0) {
+#ifdef HAVE_ZLIB
+    gz = NULL;
+#endif
+}
+
+ListReader::~ListReader() {
+#ifdef HAVE_ZLIB
+    if (gz) {
+        gzclose(gz);
+        //gzclose closed the descriptor of the file too
+        file = NULL;
+    }
+#endif
+    if (file && file != stdin) {
+        fclose(file);
+    }
+}
+
+bool ListReader::Open(std::string path) {
+    file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    if (file != stdin) {
+        unsigned char magic[4] = { 0 };
+        size_t got = fread(magic, 1, 4, file);
+        rewind(file);
+        if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+            std::cout << path << " is zstd compressed, pipe it in instead: zstdcat " << path << " | download -b -" << std::endl;
+            return false;
+        }
+    }
+#ifdef HAVE_ZLIB
+    //zlib passes uncompressed input through unchanged
+    gz = gzdopen(fileno(file), "rb");
+    if (!gz) {
+        return false;
+    }
+    gzbuffer(gz, 256 * 1024);
+#endif
+    return true;
+}
+
+bool ListReader::Fill() {
+    //keep the partial line at the start of the buffer
+    if (pos > 0) {
+        memmove(buffer.data(), buffer.data() + pos, end - pos);
+        end -= pos;
+        pos = 0;
+    }
+    if (end == buffer.size()) {
+        //a line longer than the buffer
+        buffer.resize(buffer.size() * 2);
+    }
+#ifdef HAVE_ZLIB
+    int got = gzread(gz, buffer.data() + end, (unsigned)(buffer.size() - end));
+    if (got <= 0) {
+        eof = true;
+        return false;
+    }
+#else
+    size_t got = fread(buffer.data() + end, 1, buffer.size() - end, file);
+    if (got == 0) {
+        eof = true;
+        return false;
+    }
+#endif
+    end += got;
+    return true;
+}
+
+bool ListReader::NextLine(std::string& line) {
+    while (true) {
+        char* start = buffer.data() + pos;
+        char* newline = (char*)memchr(start, '\n', end - pos);
+        if (newline) {
+            size_t len = newline - start;
+            if (len > 0 && start[len - 1] == '\r') {
+                len--;
+            }
+            line.assign(start, len);
+            pos = newline - buffer.data() + 1;
+            lines++;
+            return true;
+        }
+        if (eof || !Fill()) {
+            if (pos == end) {
+                return false;
+            }
+            //last line without a line break
+            line.assign(buffer.data() + pos, end - pos);
+            pos = end;
+            lines++;
+            return true;
+        }
+    }
+}
+
+long long ListReader::Lines() {
+    return lines;
+}
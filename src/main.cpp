@@ -2,8 +2,49 @@
 
 int totaldotz = 40;
 
+void PrintOptionalParams() {
+    std::cout << std::endl << "Optional parameters:" << std::endl;
+    std::cout << "-v | --verbose => enable verbose mode" << std::endl;
+    std::cout << "-b [list file] | --batch [list file] => download every \"url [output]\" line of the file (plain or .gz, - for stdin) into the -o directory" << std::endl;
+    std::cout << "--lookahead [count] => batch jobs read (and planned) ahead of the transfers (default 10000)" << std::endl;
+    std::cout << "-j [count] | --jobs [count] => number of concurrent transfers in batch mode (default 8)" << std::endl;
+    std::cout << "--threads [count] => run the batch transfers on this many event loops, one thread per core, urls of a host stay on one loop (default 1)" << std::endl;
+    std::cout << "--journal [file] => record finished batch jobs in this file; running the batch again skips them and continues partial downloads" << std::endl;
+    std::cout << "--fanout [levels] => spread the batch outputs over 1 or 2 levels of hash-prefix subdirectories of the -o directory (00/ to ff/), for lists of millions of files" << std::endl;
+    std::cout << "--pack [file.tar|file.warc] => append every batch download to this tar or WARC file (with a .idx index of \"offset length name\" lines) instead of writing separate files" << std::endl;
+    std::cout << "--dns-prefetch => resolve the hosts of each batch window at once (A and AAAA queries in parallel) before their transfers start" << std::endl;
+    std::cout << "--dns-cache [file] => with --dns-prefetch, keep the answers in this file until their TTL runs out so later runs skip the lookups (implies --dns-prefetch)" << std::endl;
+    std::cout << "--dns-server [ip[:port]] => nameserver --dns-prefetch asks (default the first one of /etc/resolv.conf)" << std::endl;
+    std::cout << "--retries [count] => retries per batch job before giving up (default 3)" << std::endl;
+    std::cout << "--schedule [lpt|fifo] => probe sizes with HEAD and run the largest batch jobs first, or keep list order (default lpt)" << std::endl;
+    std::cout << "--splice => fetch plain http:// urls with a built-in HTTP/1.1 client that moves the body into the file with splice(), without copying it (Linux; other responses and urls behind an http_proxy/all_proxy fall back to curl)" << std::endl;
+    std::cout << "--segments [count] => download over this many connections with range requests (default 1, 4 with -o -)" << std::endl;
+    std::cout << "--max-buffer-mem [MiB] => budget for download data held in memory (packed bodies, out of order segments, playlist segments, stream ranges), transfers pause while it is used up (default 256)" << std::endl;
+    std::cout << "--segment-mem [MiB] => memory cap for data held back to keep stdout in order (default 64)" << std::endl;
+    std::cout << "--ranges [a-b,c-d,...] => only fetch these byte ranges of the url" << std::endl;
+    std::cout << "--ranges-format [sparse|stream] => write the ranges at their offsets of a sparse file, or as length-prefixed records (default sparse)" << std::endl;
+    std::cout << "--zip-member [path in archive] => extract only this member of a remote zip archive" << std::endl;
+    std::cout << "--playlist => the url is an HLS (m3u8) or DASH (mpd) manifest, download its segments into one file" << std::endl;
+    std::cout << "--follow => keep polling the url and append what was added to it to the output file" << std::endl;
+    std::cout << "--follow-interval [seconds] => poll interval while the file grows, it backs off up to 60s while it doesn't (default 1)" << std::endl;
+    std::cout << "--recursive => mirror the pages linked from the url (below its directory) into the -o directory, or the whole tree below an ftp:// directory" << std::endl;
+    std::cout << "--depth [count] => how many links deep --recursive goes (default 5, 32 directory levels for ftp)" << std::endl;
+    std::cout << "--delay [ms] => minimum time between two requests to the same host in --recursive mode (default 0)" << std::endl;
+    std::cout << "--check => only check that the -u url or the urls of the -b list exist (HEAD requests), print \"status size latency_ms url\" for each" << std::endl;
+    std::cout << "--sync [manifest] => make the -o directory match a list of \"url size sha256 [path]\" lines, downloading only missing or changed files" << std::endl;
+    std::cout << "--delete => with --sync, also delete the files the manifest doesn't list" << std::endl;
+    std::cout << "--proxy-cache [port] => run as a caching HTTP forward proxy on 127.0.0.1:port for other tools (http_proxy=http://127.0.0.1:port)" << std::endl;
+    std::cout << "--proxy-cache-dir [directory] => where --proxy-cache keeps the responses (default ~/.cache/download/proxy)" << std::endl;
+    std::cout << "--tls-cache [file|off] => file the TLS sessions are kept in between runs, so later downloads from the same hosts resume them (default ~/.cache/download/tls-sessions)" << std::endl;
+    std::cout << "--net-profile [lan|wan|satellite] => tune the sockets for the network: receive buffers sized from the measured round trip and throughput, TCP Fast Open and keepalive" << std::endl;
+    std::cout << "--stall-speed [bytes/s] => throughput floor below which a transfer counts as stalled (default 1024)" << std::endl;
+    std::cout << "--stall-time [seconds] => window the throughput floor is checked over (default 30)" << std::endl;
+    std::cout << "--reconnects [count] => times a stalled download is resumed on a fresh connection (default 5)" << std::endl;
+}
+
 int main(int argc, char** argv){
-    std::vector<std::string> opts = {"-o","--output","--url","-u","-v","--verbose"};
+    CurlGlobal curlGlobal;
+    std::vector<std::string> opts = {"-o","--output","--url","-u","-v","--verbose","-b","--batch","-j","--jobs","--retries","--stall-speed","--stall-time","--reconnects","--schedule","--segments","--segment-mem","--ranges","--ranges-format","--zip-member","--playlist","--follow","--follow-interval","--recursive","--depth","--delay","--check","--sync","--delete","--lookahead","--journal","--pack","--fanout","--max-buffer-mem","--threads","--dns-prefetch","--dns-cache","--dns-server","--tls-cache","--net-profile","--splice","--proxy-cache","--proxy-cache-dir"};
     ArgsParser parser(opts);
     
     //parse params
@@ -16,6 +57,37 @@ int main(int argc, char** argv){
     bool urlFound = false;
     std::string url = "";
     bool verbose = false;
+    BatchOptions batch;
+    bool batchFound = false;
+    StallOptions stall;
+    SegmentOptions segments;
+    segments.connections = 1;
+    std::string rangeList = "";
+    std::string zipMember = "";
+    bool playlist = false;
+    bool follow = false;
+    FollowOptions followOpts;
+    bool recursive = false;
+    CrawlOptions crawlOpts;
+    bool depthFound = false;
+    bool check = false;
+    bool splice = false;
+    ProxyOptions proxyOpts;
+    proxyOpts.cacheDir = DefaultProxyCache();
+    std::string tlsCache = DefaultTlsCache();
+    bool tlsCacheFound = false;
+    SyncOptions syncOpts;
+    bool syncFound = false;
+    bool jobsFound = false;
+    bool rangeStream = false;
+    Buffers().SetBudget(256 * 1024 * 1024);
+
+    //with "-o -" the data goes to stdout, so every message moves to stderr
+    for (int i = 0; i < result.size(); i++) {
+        if ((result[i].first.first == "-o" || result[i].first.first == "--output") && result[i].second && result[i].first.second == "-") {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+    }
 
     for (int i = 0; i < result.size(); i++) {
         if (result[i].first.first=="-o" || result[i].first.first == "--output") {
@@ -41,59 +113,437 @@ int main(int argc, char** argv){
                 verbose = true;
             }
         }
+        else if (result[i].first.first == "-b" || result[i].first.first == "--batch") {
+            if (result[i].second && result[i].first.second != "") {
+                batch.listFile = result[i].first.second;
+                batchFound = true;
+            }
+        }
+        else if (result[i].first.first == "-j" || result[i].first.first == "--jobs") {
+            if (result[i].second && atoi(result[i].first.second.c_str()) > 0) {
+                batch.jobs = atoi(result[i].first.second.c_str());
+                jobsFound = true;
+            }
+        }
+        else if (result[i].first.first == "--threads") {
+            if (result[i].second && atoi(result[i].first.second.c_str()) > 0) {
+                batch.threads = atoi(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--lookahead") {
+            if (result[i].second && atol(result[i].first.second.c_str()) > 0) {
+                batch.lookahead = (size_t)atol(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--journal") {
+            if (result[i].second) {
+                batch.journal = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--fanout") {
+            if (result[i].second && atoi(result[i].first.second.c_str()) >= 0) {
+                batch.fanout = std::min(atoi(result[i].first.second.c_str()), 4);
+            }
+        }
+        else if (result[i].first.first == "--pack") {
+            if (result[i].second) {
+                batch.pack = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--dns-prefetch") {
+            if (result[i].second) {
+                batch.dnsPrefetch = true;
+            }
+        }
+        else if (result[i].first.first == "--dns-cache") {
+            if (result[i].second && result[i].first.second != "") {
+                batch.dnsCache = result[i].first.second;
+                batch.dnsPrefetch = true;
+            }
+        }
+        else if (result[i].first.first == "--dns-server") {
+            if (result[i].second && result[i].first.second != "") {
+                batch.dnsServer = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--retries") {
+            if (result[i].second) {
+                batch.maxRetries = atoi(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--schedule") {
+            if (result[i].second && (result[i].first.second == "lpt" || result[i].first.second == "fifo")) {
+                batch.schedule = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--segments") {
+            if (result[i].second && atoi(result[i].first.second.c_str()) > 0) {
+                segments.connections = atoi(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--max-buffer-mem") {
+            if (result[i].second && atol(result[i].first.second.c_str()) > 0) {
+                Buffers().SetBudget((size_t)atol(result[i].first.second.c_str()) * 1024 * 1024);
+            }
+        }
+        else if (result[i].first.first == "--segment-mem") {
+            if (result[i].second && atol(result[i].first.second.c_str()) > 0) {
+                segments.memoryCap = (curl_off_t)atol(result[i].first.second.c_str()) * 1024 * 1024;
+            }
+        }
+        else if (result[i].first.first == "--ranges") {
+            if (result[i].second) {
+                rangeList = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--ranges-format") {
+            if (result[i].second) {
+                rangeStream = result[i].first.second == "stream";
+            }
+        }
+        else if (result[i].first.first == "--zip-member") {
+            if (result[i].second) {
+                zipMember = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--proxy-cache") {
+            if (result[i].second && atoi(result[i].first.second.c_str()) > 0 && atoi(result[i].first.second.c_str()) < 65536) {
+                proxyOpts.port = atoi(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--proxy-cache-dir") {
+            if (result[i].second && result[i].first.second != "") {
+                proxyOpts.cacheDir = result[i].first.second;
+            }
+        }
+        else if (result[i].first.first == "--splice") {
+            if (result[i].second) {
+                splice = true;
+            }
+        }
+        else if (result[i].first.first == "--playlist") {
+            if (result[i].second) {
+                playlist = true;
+            }
+        }
+        else if (result[i].first.first == "--follow") {
+            if (result[i].second) {
+                follow = true;
+            }
+        }
+        else if (result[i].first.first == "--follow-interval") {
+            if (result[i].second && atof(result[i].first.second.c_str()) > 0) {
+                followOpts.minInterval = atof(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--recursive") {
+            if (result[i].second) {
+                recursive = true;
+            }
+        }
+        else if (result[i].first.first == "--depth") {
+            if (result[i].second) {
+                crawlOpts.maxDepth = atoi(result[i].first.second.c_str());
+                depthFound = true;
+            }
+        }
+        else if (result[i].first.first == "--delay") {
+            if (result[i].second) {
+                crawlOpts.hostDelay = atof(result[i].first.second.c_str()) / 1000;
+            }
+        }
+        else if (result[i].first.first == "--check") {
+            if (result[i].second) {
+                check = true;
+            }
+        }
+        else if (result[i].first.first == "--sync") {
+            if (result[i].second && result[i].first.second != "") {
+                syncOpts.manifest = result[i].first.second;
+                syncFound = true;
+            }
+        }
+        else if (result[i].first.first == "--delete") {
+            if (result[i].second) {
+                syncOpts.deleteStale = true;
+            }
+        }
+        else if (result[i].first.first == "--stall-speed") {
+            if (result[i].second && atol(result[i].first.second.c_str()) > 0) {
+                stall.minSpeed = atol(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--stall-time") {
+            if (result[i].second && atof(result[i].first.second.c_str()) > 0) {
+                stall.window = atof(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--reconnects") {
+            if (result[i].second) {
+                stall.maxReconnects = atoi(result[i].first.second.c_str());
+            }
+        }
+        else if (result[i].first.first == "--tls-cache") {
+            if (result[i].second && result[i].first.second != "") {
+                tlsCache = result[i].first.second;
+                tlsCacheFound = true;
+            }
+        }
+        else if (result[i].first.first == "--net-profile") {
+            NetProfile profile;
+            if (result[i].second && ParseNetProfile(result[i].first.second, profile)) {
+                Network().SetProfile(profile);
+            }
+        }
     }
 
-    if (!outputFound || !urlFound) {
-        if (!outputFound && !urlFound) {
-            std::cout << "Please provide the following parameters:" << std::endl;
-            std::cout << "-o [file name] | --output [file name] => specify the output file name" << std::endl;
-            std::cout << "-u [url] | --url [url] => specify the url of the file to download" << std::endl;
-            std::cout << std::endl << "Optional parameters:" << std::endl;
-            std::cout << "-v | --verbose => enable verbose mode" << std::endl;
+    //every handle from here on shares the sessions of earlier runs
+    if (tlsCache != "off" && !Sessions().Open(tlsCache) && tlsCacheFound) {
+        std::cout << "--tls-cache needs a build with OpenSSL, sessions are only kept for this run" << std::endl;
+    }
+
+    if (proxyOpts.port > 0) {
+        proxyOpts.verbose = verbose;
+        proxyOpts.stall = stall;
+        return RunProxyCache(proxyOpts) ? 0 : 1;
+    }
+
+    if (check && (batchFound || urlFound)) {
+        CheckOptions checkOpts;
+        checkOpts.listFile = batchFound ? batch.listFile : "";
+        checkOpts.url = url;
+        if (jobsFound) {
+            checkOpts.connections = batch.jobs;
+        }
+        CheckStats stats;
+        return RunCheck(checkOpts, stats) ? 0 : 1;
+    }
+
+    if (syncFound) {
+        syncOpts.batch = batch;
+        syncOpts.batch.verbose = verbose;
+        syncOpts.batch.stall = stall;
+        if (outputFound) {
+            syncOpts.batch.outputDir = output;
+        }
+        SyncStats stats;
+        return RunSync(syncOpts, stats) ? 0 : 1;
+    }
+
+    if (batchFound) {
+        batch.verbose = verbose;
+        batch.stall = stall;
+        if (outputFound) {
+            batch.outputDir = output;
         }
-        else if (!outputFound) {
-            std::cout << "Please provide the following parameters:" << std::endl;
+        return RunBatch(batch);
+    }
+
+    if (!outputFound || !urlFound) {
+        std::cout << "Please provide the following parameters:" << std::endl;
+        if (!outputFound) {
             std::cout << "-o [file name] | --output [file name] => specify the output file name" << std::endl;
-            std::cout << std::endl << "Optional parameters:" << std::endl;
-            std::cout << "-v | --verbose => enable verbose mode" << std::endl;
         }
-        else {
-            std::cout << "Please provide the following parameters:" << std::endl;
+        if (!urlFound) {
             std::cout << "-u [url] | --url [url] => specify the url of the file to download" << std::endl;
-            std::cout << std::endl << "Optional parameters:" << std::endl;
-            std::cout << "-v | --verbose => enable verbose mode" << std::endl;
         }
+        PrintOptionalParams();
         ShowCursor();
         return 1;
     }
 
     std::cout<<"starting curl example"<<std::endl;
+    bool toStdout = output == "-";
+    if (toStdout) {
+#ifndef __linux__
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        //a pipe can't be resumed or meter'd, so don't draw on the terminal either
+        verbose = false;
+        if (segments.connections == 1) {
+            segments.connections = 4;
+        }
+    }
+    if (recursive && (url.compare(0, 6, "ftp://") == 0 || url.compare(0, 7, "ftps://") == 0)) {
+        FtpMirrorOptions ftpOpts;
+        ftpOpts.outputDir = output;
+        ftpOpts.verbose = verbose;
+        if (depthFound) {
+            ftpOpts.maxDepth = crawlOpts.maxDepth;
+        }
+        if (segments.connections > 1) {
+            ftpOpts.connections = segments.connections;
+        }
+        FtpMirrorStats stats;
+        double started = NowSeconds();
+        bool ok = MirrorFtp(url, ftpOpts, stats);
+        std::cout << stats.files << " files (" << stats.bytes << " bytes) in " << stats.dirs << " directories fetched, "
+            << stats.skipped << " unchanged, " << stats.failed << " failed in " << NowSeconds() - started << "s" << std::endl;
+        return ok ? 0 : 1;
+    }
+    if (recursive) {
+        crawlOpts.outputDir = output;
+        crawlOpts.verbose = verbose;
+        if (segments.connections > 1) {
+            crawlOpts.connections = segments.connections;
+        }
+        CrawlStats stats;
+        double started = NowSeconds();
+        bool ok = Crawl(url, crawlOpts, stats);
+        std::cout << stats.fetched << " pages (" << stats.bytes << " bytes) fetched, " << stats.failed << " failed, "
+            << stats.links << " links queued in " << NowSeconds() - started << "s" << std::endl;
+        return ok ? 0 : 1;
+    }
+    if (follow) {
+        if (toStdout) {
+            std::cout << "--follow needs an output file" << std::endl;
+            return 1;
+        }
+        followOpts.verbose = verbose;
+        return FollowFile(url, output, followOpts) ? 0 : 1;
+    }
+    if (playlist) {
+        FILE* out = toStdout ? stdout : fopen(output.c_str(), "wb");
+        if (!out) {
+            std::cout << "error while opening file" << std::endl;
+            return 1;
+        }
+        PlaylistOptions popts;
+        popts.verbose = verbose;
+        if (segments.connections > 1) {
+            popts.connections = segments.connections;
+        }
+        PlaylistStats stats;
+        bool ok = DownloadPlaylist(url, out, popts, stats);
+        if (!toStdout) {
+            fclose(out);
+        }
+        std::cout << (ok ? "request performed successfully!" : "request failed !") << std::endl;
+        std::cout << stats.segments << " segments, " << stats.bytes << " bytes";
+        if (stats.reloads > 0) {
+            std::cout << ", " << stats.reloads << " playlist reloads";
+        }
+        std::cout << std::endl;
+        return ok ? 0 : 1;
+    }
+    if (zipMember != "") {
+        FILE* out = toStdout ? stdout : fopen(output.c_str(), "wb");
+        if (!out) {
+            std::cout << "error while opening file" << std::endl;
+            return 1;
+        }
+        ZipMemberStats stats;
+        bool ok = ExtractZipMember(url, zipMember, out, stats);
+        if (!toStdout) {
+            fclose(out);
+        }
+        std::cout << (ok ? "request performed successfully!" : "request failed !") << std::endl;
+        if (ok) {
+            std::cout << "fetched " << stats.metadataBytes + stats.compressedSize << " of " << stats.archiveSize
+                << " archive bytes in " << stats.requests << " requests" << std::endl;
+        }
+        return ok ? 0 : 1;
+    }
+    if (rangeList != "") {
+        std::vector<ByteRange> ranges;
+        if (!ParseRanges(rangeList, ranges)) {
+            std::cout << "invalid range list: " << rangeList << std::endl;
+            return 1;
+        }
+        FILE* out = toStdout ? stdout : fopen(output.c_str(), "wb");
+        if (!out) {
+            std::cout << "error while opening file" << std::endl;
+            return 1;
+        }
+        RangeOutput sink(out, rangeStream);
+        RangeStats stats;
+        bool ok = DownloadRanges(url, ranges, sink, segments.connections > 1 ? segments.connections : 4, stats);
+        if (!toStdout) {
+            fclose(out);
+        }
+        std::cout << (ok ? "request performed successfully!" : "request failed !") << std::endl;
+        std::cout << ranges.size() << " ranges in " << stats.requests << " requests";
+        if (stats.multipart && (int)ranges.size() > stats.requests) {
+            std::cout << " (multipart, " << (int)ranges.size() - stats.requests << " round trips saved)";
+        }
+        if (stats.wholeBody) {
+            std::cout << " (no range support, cut out of the whole file)";
+        }
+        std::cout << std::endl;
+        return ok ? 0 : 1;
+    }
+    if (segments.connections > 1) {
+        FILE* out = toStdout ? stdout : fopen(output.c_str(), "wb");
+        if (!out) {
+            std::cout << "error while opening file" << std::endl;
+            return 1;
+        }
+        SegmentResult segmented = DownloadSegmented(url, out, toStdout, segments);
+        if (!toStdout) {
+            fclose(out);
+        }
+        if (segmented == SegmentResult::Ok) {
+            std::cout << "request performed successfully!" << std::endl;
+            return 0;
+        }
+        if (segmented == SegmentResult::Failed) {
+            std::cout << "request failed !" << std::endl;
+            return 1;
+        }
+        std::cout << "no range support, using a single connection" << std::endl;
+    }
+    if (splice && !toStdout) {
+        FILE* out = fopen(output.c_str(), "wb");
+        if (!out) {
+            std::cout << "error while opening file" << std::endl;
+            return 1;
+        }
+        SpliceStats stats;
+        SpliceResult spliced = DownloadSpliced(url, out, stats);
+        fclose(out);
+        if (spliced != SpliceResult::Unsupported) {
+            std::cout << (spliced == SpliceResult::Ok ? "request performed successfully!" : "request failed !") << std::endl;
+            if (verbose) {
+                std::cout << "splice: " << stats.bytes << " bytes in " << stats.seconds << "s, " << stats.spliced << " of them spliced" << std::endl;
+            }
+            return spliced == SpliceResult::Ok ? 0 : 1;
+        }
+        if (verbose) {
+            std::cout << "splice: proxied url or not a plain 200 response, using curl" << std::endl;
+        }
+    }
     CURL* curl;
     CURLcode Curlresult;
     
     curl= curl_easy_init();
 
     if(curl){
+        Sessions().Attach(curl);
+        Network().Apply(curl);
         curl_easy_setopt(curl,CURLOPT_URL, url.c_str());
         /* allow redirections */
         curl_easy_setopt(curl,CURLOPT_FOLLOWLOCATION, 1L);
 
         if (verbose) {
-            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
             curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-            curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progress_func);
         }
 
         FILE* file;
 
-        file = fopen(output.c_str(), "wb");
+        file = toStdout ? stdout : fopen(output.c_str(), "wb");
 
         if (file) {
             curl_easy_setopt(curl, CURLOPT_WRITEDATA, file);
-            HideCursor();
-            /* do request */
-            Curlresult = curl_easy_perform(curl);
-            ShowCursor();
+            ResumeStats stats;
+            if (toStdout) {
+                Curlresult = curl_easy_perform(curl);
+            }
+            else {
+                HideCursor();
+                /* do request, reconnecting when it stalls */
+                Curlresult = PerformWithResume(curl, file, output, url, stall, stats, verbose ? progress_func : NULL);
+                ShowCursor();
+            }
             if (Curlresult != CURLE_OK) {
                 std::cout << "request failed !" << std::endl;
             }
@@ -107,13 +557,44 @@ int main(int argc, char** argv){
                 }
                 std::cout << "request performed successfully!" << std::endl;
             }
-            fclose(file);
+            if (stats.reconnects > 0 || stats.stalledTime > 0) {
+                std::cout << "reconnects: " << stats.reconnects << ", time stalled: " << stats.stalledTime << "s" << std::endl;
+            }
+            if (verbose && Sessions().Active()) {
+                double connected = 0;
+                double handshaken = 0;
+                double firstByte = 0;
+                curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connected);
+                curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &handshaken);
+                curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &firstByte);
+                std::cout << "tls: " << Sessions().Loaded() << " cached sessions";
+                if (Sessions().Resumed() >= 0) {
+                    std::cout << ", " << Sessions().Resumed() << " resumed and " << Sessions().Full() << " full handshakes";
+                }
+                if (handshaken > 0) {
+                    std::cout << ", handshake " << (handshaken - connected) * 1000 << " ms";
+                }
+                std::cout << ", first byte after " << firstByte * 1000 << " ms" << std::endl;
+            }
+            if (verbose && Network().Active()) {
+                Network().Record(curl);
+                HostPath path = Network().Hosts()[HostOf(url)];
+                std::cout << "net " << Network().Name() << ": rtt " << path.rtt * 1000 << " ms, " << (long long)(path.rate / 1024) << " KB/s, receive buffer ";
+                if (path.buffer > 0) {
+                    std::cout << path.buffer / 1024 << " KB" << std::endl;
+                }
+                else {
+                    std::cout << "autotuned" << std::endl;
+                }
+            }
+            if (file && !toStdout) {
+                fclose(file);
+            }
         }
         else {
             std::cout << "error while opening file" << std::endl;
         }
         curl_easy_cleanup(curl);
-        curl_global_cleanup();
     }
     else{
         std::cout<<"error initializing curl!"<<std::endl;
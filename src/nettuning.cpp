@@ -0,0 +1,231 @@
+#include <nettuning.hpp>
+#include <util.hpp>
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#else
+#include <winsock2.h>
+#endif
+
+//transfers shorter than this end in slow start and don't show the link rate
+static const curl_off_t minRateSample = 256 * 1024;
+
+bool ParseNetProfile(std::string name, NetProfile& profile) {
+    NetProfile p;
+    p.name = name;
+    if (name == "lan") {
+        p.rtt = 0.001;
+        p.rate = 1250000000.0;
+        p.minBuffer = 256 * 1024;
+        p.maxBuffer = 16 * 1024 * 1024;
+        p.keepIdle = 30;
+        p.keepInterval = 10;
+    }
+    else if (name == "wan") {
+        p.rtt = 0.08;
+        p.rate = 25000000.0;
+        p.minBuffer = 256 * 1024;
+        p.maxBuffer = 32 * 1024 * 1024;
+        p.fastOpen = true;
+        p.keepIdle = 60;
+        p.keepInterval = 20;
+    }
+    else if (name == "satellite") {
+        p.rtt = 0.6;
+        p.rate = 6250000.0;
+        p.minBuffer = 1024 * 1024;
+        p.maxBuffer = 64 * 1024 * 1024;
+        p.fastOpen = true;
+        p.keepIdle = 120;
+        p.keepInterval = 30;
+    }
+    else {
+        return false;
+    }
+    profile = p;
+    return true;
+}
+
+#ifdef __linux__
+static long long ReadProcValue(const char* path, int field) {
+    std::ifstream in(path);
+    long long value = 0;
+    for (int i = 0; i <= field; i++) {
+        if (!(in >> value)) {
+            return 0;
+        }
+    }
+    return value;
+}
+#endif
+
+NetTuner::NetTuner() : active(false) {
+#ifdef __linux__
+    //the kernel doubles SO_RCVBUF for its bookkeeping, the limits are of the doubled size
+    autotuneMax = (int)std::min<long long>(ReadProcValue("/proc/sys/net/ipv4/tcp_rmem", 2) / 2, INT_MAX);
+    grantMax = (int)std::min<long long>(ReadProcValue("/proc/sys/net/core/rmem_max", 0), INT_MAX);
+    if (autotuneMax <= 0) {
+        autotuneMax = 3 * 1024 * 1024;
+    }
+#else
+    //windows grows the receive window to 16MB by itself, and grants any SO_RCVBUF
+    autotuneMax = 16 * 1024 * 1024;
+    grantMax = INT_MAX;
+#endif
+}
+
+void NetTuner::SetProfile(const NetProfile& p) {
+    std::lock_guard<std::mutex> guard(lock);
+    profile = p;
+    active = true;
+}
+
+bool NetTuner::Active() {
+    std::lock_guard<std::mutex> guard(lock);
+    return active;
+}
+
+std::string NetTuner::Name() {
+    std::lock_guard<std::mutex> guard(lock);
+    return profile.name;
+}
+
+void NetTuner::Apply(CURL* curl) {
+    NetProfile p;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!active) {
+            return;
+        }
+        p = profile;
+    }
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, p.noDelay ? 1L : 0L);
+    if (p.keepIdle > 0) {
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, p.keepIdle);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, p.keepInterval);
+    }
+    if (p.fastOpen) {
+        //a resumed connection sends its request with the SYN, libcurl ignores it where the os can't
+        curl_easy_setopt(curl, CURLOPT_TCP_FASTOPEN, 1L);
+    }
+    curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, SocketOptions);
+    curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, curl);
+}
+
+int NetTuner::SocketOptions(void* data, curl_socket_t fd, curlsocktype purpose) {
+    if (purpose != CURLSOCKTYPE_IPCXN) {
+        return CURL_SOCKOPT_OK;
+    }
+    char* url = NULL;
+    curl_easy_getinfo((CURL*)data, CURLINFO_EFFECTIVE_URL, &url);
+    Network().SizeReceiveBuffer(fd, url ? HostOf(url) : "");
+    return CURL_SOCKOPT_OK;
+}
+
+void NetTuner::Apply(curl_socket_t fd, const std::string& host) {
+    NetProfile p;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!active) {
+            return;
+        }
+        p = profile;
+    }
+    int on = p.noDelay ? 1 : 0;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    if (p.keepIdle > 0) {
+        on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (const char*)&on, sizeof(on));
+#ifdef TCP_KEEPIDLE
+        int idle = (int)p.keepIdle;
+        int interval = (int)p.keepInterval;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, (const char*)&idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, (const char*)&interval, sizeof(interval));
+#endif
+    }
+    //the window scale is settled by the handshake, the buffer has to be there before it
+    SizeReceiveBuffer(fd, host);
+}
+
+void NetTuner::SizeReceiveBuffer(curl_socket_t fd, const std::string& host) {
+    int buffer = ReceiveBuffer(host);
+    if (buffer <= 0) {
+        return;
+    }
+    bool set = false;
+#ifdef SO_RCVBUFFORCE
+    //beyond rmem_max only with CAP_NET_ADMIN
+    set = setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, (const char*)&buffer, sizeof(buffer)) == 0;
+#endif
+    if (!set && buffer > grantMax) {
+        //capped at rmem_max, which is only worth it while still above what autotuning reaches
+        buffer = grantMax > autotuneMax ? grantMax : 0;
+    }
+    if (!set && buffer > 0) {
+        set = setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer, sizeof(buffer)) == 0;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    hosts[host].buffer = set ? buffer : 0;
+}
+
+void NetTuner::Record(CURL* curl) {
+    if (!Active()) {
+        return;
+    }
+    char* url = NULL;
+    long connects = 0;
+    curl_off_t lookup = 0, connect = 0, size = 0, speed = 0;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &size);
+    curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+    if (!url) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    HostPath& path = hosts[HostOf(url)];
+    //the tcp handshake takes one round trip, only a new connection measures it
+    if (connects > 0 && connect > lookup) {
+        double rtt = (connect - lookup) / 1000000.0;
+        path.rtt = path.rtt > 0 ? path.rtt * 0.75 + rtt * 0.25 : rtt;
+    }
+    if (size >= minRateSample) {
+        path.rate = std::max(path.rate, (double)speed);
+    }
+}
+
+int NetTuner::ReceiveBuffer(const std::string& host) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!active) {
+        return 0;
+    }
+    HostPath& path = hosts[host];
+    double rtt = path.rtt > 0 ? path.rtt : profile.rtt;
+    double rate = std::max(profile.rate, path.rate);
+    double wanted = std::min(2 * rate * rtt, (double)profile.maxBuffer);
+    int buffer = std::max((int)wanted, profile.minBuffer);
+    //autotuning gets there by itself and keeps small windows for slow paths,
+    //a fixed buffer turns it off
+    if (buffer <= autotuneMax) {
+        path.buffer = 0;
+        return 0;
+    }
+    return buffer;
+}
+
+std::map<std::string, HostPath> NetTuner::Hosts() {
+    std::lock_guard<std::mutex> guard(lock);
+    return hosts;
+}
+
+NetTuner& Network() {
+    static NetTuner tuner;
+    return tuner;
+}
@@ -0,0 +1,184 @@
+#include <outputtree.hpp>
+#include <util.hpp>
+#include <set>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+//splits a path into its directory ("" for the current one) and last component
+static void SplitPath(const std::string& path, std::string& dir, std::string& name) {
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        dir = "";
+        name = path;
+    }
+    else {
+        dir = slash == 0 ? "/" : path.substr(0, slash);
+        name = path.substr(slash + 1);
+    }
+}
+
+OutputTree::OutputTree(size_t maxFds) : maxFds(maxFds < 2 ? 2 : maxFds) {}
+
+OutputTree::~OutputTree() {
+#ifdef __linux__
+    for (auto& d : fds) {
+        close(d.second.first);
+    }
+#endif
+}
+
+std::string OutputTree::TempPath(const std::string& path) {
+    return path + ".part";
+}
+
+#ifdef __linux__
+//fd of an open directory, AT_FDCWD for "" and -1 if it can't be opened.
+//Missing directories are created when asked to
+int OutputTree::Dir(const std::string& path, bool create) {
+    if (path == "" || path == ".") {
+        return AT_FDCWD;
+    }
+    auto d = fds.find(path);
+    if (d != fds.end()) {
+        recent.splice(recent.begin(), recent, d->second.second);
+        return d->second.first;
+    }
+    int fd = -1;
+    std::string parent, name;
+    SplitPath(path, parent, name);
+    if (path == "/") {
+        fd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    else {
+        //the parent is opened (and cached) first, the directory relative to it
+        int parentFd = Dir(parent, create);
+        if (parentFd == -1) {
+            return -1;
+        }
+        if (name == "" || name == ".") {
+            return parentFd;
+        }
+        fd = openat(parentFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0 && errno == ENOENT && create && (mkdirat(parentFd, name.c_str(), 0755) == 0 || errno == EEXIST)) {
+            fd = openat(parentFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    recent.push_front(path);
+    fds[path] = std::make_pair(fd, recent.begin());
+    while (fds.size() > maxFds) {
+        auto old = fds.find(recent.back());
+        close(old->second.first);
+        fds.erase(old);
+        recent.pop_back();
+    }
+    return fd;
+}
+
+void OutputTree::Prepare(const std::vector<std::string>& outputs) {
+    //sorted, every parent comes before its subdirectories and is still cached
+    std::set<std::string> dirs;
+    std::string dir, name;
+    for (const std::string& o : outputs) {
+        SplitPath(o, dir, name);
+        dirs.insert(dir);
+    }
+    for (const std::string& d : dirs) {
+        Dir(d, true);
+    }
+}
+
+FILE* OutputTree::Open(const std::string& path, const char* mode) {
+    std::string dir, name;
+    SplitPath(path, dir, name);
+    int dirFd = Dir(dir, true);
+    if (dirFd == -1) {
+        return NULL;
+    }
+    int flags = O_CLOEXEC;
+    if (mode[0] == 'r') {
+        flags |= O_RDWR;
+    }
+    else {
+        flags |= O_WRONLY | O_CREAT | (mode[0] == 'a' ? O_APPEND : O_TRUNC);
+    }
+    int fd = openat(dirFd, (name + ".part").c_str(), flags, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    FILE* file = fdopen(fd, mode);
+    if (!file) {
+        close(fd);
+    }
+    return file;
+}
+
+bool OutputTree::Publish(const std::string& path) {
+    std::string dir, name;
+    SplitPath(path, dir, name);
+    int dirFd = Dir(dir, false);
+    return dirFd != -1 && renameat(dirFd, (name + ".part").c_str(), dirFd, name.c_str()) == 0;
+}
+
+void OutputTree::Discard(const std::string& path) {
+    std::string dir, name;
+    SplitPath(path, dir, name);
+    int dirFd = Dir(dir, false);
+    if (dirFd != -1) {
+        unlinkat(dirFd, (name + ".part").c_str(), 0);
+    }
+}
+#else
+//no directory fds here, the same operations by path
+int OutputTree::Dir(const std::string&, bool) {
+    return -1;
+}
+
+void OutputTree::Prepare(const std::vector<std::string>& outputs) {
+    std::set<std::string> dirs;
+    std::string dir, name;
+    for (const std::string& o : outputs) {
+        SplitPath(o, dir, name);
+        dirs.insert(dir);
+    }
+    for (const std::string& d : dirs) {
+        MakeParentDirs(d + "/");
+    }
+}
+
+FILE* OutputTree::Open(const std::string& path, const char* mode) {
+    return fopen(TempPath(path).c_str(), mode);
+}
+
+bool OutputTree::Publish(const std::string& path) {
+    remove(path.c_str());
+    return rename(TempPath(path).c_str(), path.c_str()) == 0;
+}
+
+void OutputTree::Discard(const std::string& path) {
+    remove(TempPath(path).c_str());
+}
+#endif
+
+std::string FanoutPath(std::string name, int levels) {
+    //FNV-1a, one byte of the hash per level
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    std::string prefix = "";
+    char level[4];
+    for (int i = 0; i < levels && i < 4; i++) {
+        snprintf(level, sizeof(level), "%02x/", (hash >> (8 * i)) & 0xff);
+        prefix += level;
+    }
+    return prefix + name;
+}
@@ -0,0 +1,214 @@
+#include <pack.hpp>
+#include <util.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <ctime>
+
+static const size_t tarBlock = 512;
+
+PackWriter::PackWriter() : file(NULL), index(NULL), format(PackFormat::Tar), offset(0), records(0), rng(std::random_device()()) {}
+
+PackWriter::~PackWriter() {
+    Close();
+}
+
+bool PackWriter::Write(const void* data, size_t len) {
+    if (len > 0 && fwrite(data, 1, len, file) != len) {
+        return false;
+    }
+    offset += len;
+    return true;
+}
+
+bool PackWriter::WriteBody(const BufferChain& body) {
+    for (size_t i = 0; i < body.Blocks(); i++) {
+        if (!Write(body.Block(i), body.BlockLength(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//numeric tar field: octal, or base-256 when it doesn't fit
+static void TarNumber(char* field, size_t width, curl_off_t value) {
+    if (value < ((curl_off_t)1 << (3 * (width - 1)))) {
+        snprintf(field, width, "%0*llo", (int)width - 1, (unsigned long long)value);
+        return;
+    }
+    memset(field, 0, width);
+    field[0] = (char)0x80;
+    for (size_t i = width - 1; i > 0 && value > 0; i--) {
+        field[i] = (char)(value & 0xff);
+        value >>= 8;
+    }
+}
+
+bool PackWriter::TarHeader(std::string name, char type, curl_off_t size) {
+    char header[tarBlock];
+    memset(header, 0, sizeof(header));
+    std::string prefix = "";
+    if (name.size() > 100) {
+        //split into prefix and name at a slash, or fall back to a GNU long name record
+        size_t slash = name.find('/', name.size() - 101);
+        if (slash != std::string::npos && slash <= 155 && name.size() - slash - 1 <= 100 && slash > 0) {
+            prefix = name.substr(0, slash);
+            name = name.substr(slash + 1);
+        }
+        else {
+            std::string longName = name + '\0';
+            if (!TarHeader("././@LongLink", 'L', longName.size()) || !Write(longName.data(), longName.size())) {
+                return false;
+            }
+            char pad[tarBlock] = { 0 };
+            if (!Write(pad, (tarBlock - longName.size() % tarBlock) % tarBlock)) {
+                return false;
+            }
+            name = name.substr(0, 100);
+        }
+    }
+    memcpy(header, name.data(), name.size());
+    TarNumber(header + 100, 8, 0644);
+    TarNumber(header + 108, 8, 0);
+    TarNumber(header + 116, 8, 0);
+    TarNumber(header + 124, 12, size);
+    TarNumber(header + 136, 12, (curl_off_t)time(NULL));
+    header[156] = type;
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 345, prefix.data(), prefix.size());
+    //the checksum is computed with its own field set to spaces
+    memset(header + 148, ' ', 8);
+    unsigned int sum = 0;
+    for (size_t i = 0; i < tarBlock; i++) {
+        sum += (unsigned char)header[i];
+    }
+    snprintf(header + 148, 8, "%06o", sum);
+    return Write(header, tarBlock);
+}
+
+bool PackWriter::Open(std::string path, bool append) {
+    format = path.size() >= 5 && path.compare(path.size() - 5, 5, ".warc") == 0 ? PackFormat::Warc : PackFormat::Tar;
+    std::string indexPath = path + ".idx";
+    curl_off_t end = 0;
+    curl_off_t indexEnd = 0;
+    if (append) {
+        //the pack ends after the last record the index knows about
+        curl_off_t packSize = 0;
+        time_t mtime;
+        StatFile(path, packSize, mtime);
+        std::ifstream in(indexPath, std::ios::binary);
+        std::string line;
+        curl_off_t read = 0;
+        while (std::getline(in, line)) {
+            if (in.eof()) {
+                //unterminated last line, torn
+                break;
+            }
+            read += line.size() + 1;
+            std::istringstream fields(line);
+            long long at, len;
+            if (!(fields >> at >> len)) {
+                break;
+            }
+            curl_off_t recordEnd = format == PackFormat::Tar ? (at + len + tarBlock - 1) / tarBlock * tarBlock : at + len + 4;
+            if (recordEnd > packSize) {
+                //indexed, but its data never made it to the pack
+                break;
+            }
+            indexEnd = read;
+            records++;
+            end = recordEnd;
+        }
+    }
+    if (end > 0) {
+        TruncateFile(path, end);
+        TruncateFile(indexPath, indexEnd);
+    }
+    else {
+        records = 0;
+    }
+    file = fopen(path.c_str(), end > 0 ? "ab" : "wb");
+    index = fopen(indexPath.c_str(), end > 0 ? "ab" : "wb");
+    if (!file || !index) {
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, 1024 * 1024);
+    offset = end;
+    return true;
+}
+
+bool PackWriter::Add(std::string name, std::string url, std::string contentType, const BufferChain& body) {
+    while (name.compare(0, 2, "./") == 0) {
+        name = name.substr(2);
+    }
+    name.erase(0, name.find_first_not_of('/'));
+    curl_off_t dataOffset;
+    if (format == PackFormat::Tar) {
+        if (!TarHeader(name, '0', body.Size())) {
+            return false;
+        }
+        dataOffset = offset;
+        char pad[tarBlock] = { 0 };
+        if (!WriteBody(body) || !Write(pad, (tarBlock - body.Size() % tarBlock) % tarBlock)) {
+            return false;
+        }
+    }
+    else {
+        char date[32];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        uint64_t a = rng();
+        uint64_t b = rng();
+        char id[64];
+        //random (version 4) uuid
+        snprintf(id, sizeof(id), "%08x-%04x-4%03x-%04x-%012llx", (unsigned)(a >> 32), (unsigned)(a >> 16) & 0xffff,
+            (unsigned)a & 0xfff, (unsigned)((b >> 48) & 0x3fff) | 0x8000, (unsigned long long)(b & 0xffffffffffffULL));
+        std::string head = "WARC/1.1\r\n"
+            "WARC-Type: resource\r\n"
+            "WARC-Record-ID: <urn:uuid:" + std::string(id) + ">\r\n"
+            "WARC-Date: " + date + "\r\n"
+            "WARC-Target-URI: " + url + "\r\n"
+            "Content-Type: " + (contentType != "" ? contentType : "application/octet-stream") + "\r\n"
+            "Content-Length: " + std::to_string(body.Size()) + "\r\n\r\n";
+        if (!Write(head.data(), head.size())) {
+            return false;
+        }
+        dataOffset = offset;
+        if (!WriteBody(body) || !Write("\r\n\r\n", 4)) {
+            return false;
+        }
+    }
+    records++;
+    return fprintf(index, "%lld %lld %s\n", (long long)dataOffset, (long long)body.Size(), format == PackFormat::Tar ? name.c_str() : url.c_str()) > 0;
+}
+
+void PackWriter::Flush() {
+    //the index must never point past what the pack holds
+    if (file) {
+        fflush(file);
+    }
+    if (index) {
+        fflush(index);
+    }
+}
+
+void PackWriter::Close() {
+    if (file && format == PackFormat::Tar) {
+        char end[tarBlock * 2] = { 0 };
+        Write(end, sizeof(end));
+    }
+    Flush();
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    if (index) {
+        fclose(index);
+        index = NULL;
+    }
+}
+
+long long PackWriter::Records() const {
+    return records;
+}
@@ -0,0 +1,172 @@
+#include <plan.hpp>
+#include <util.hpp>
+#include <handlepool.hpp>
+#include <resolver.hpp>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <cstdio>
+#include <cstring>
+
+struct ProbeResult {
+    BatchJob* job;
+    bool ranges = false;
+};
+
+static size_t ProbeHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    ProbeResult* r = (ProbeResult*)ptr;
+    std::string line(buffer, size * nitems);
+    //a redirect's headers are followed by the final response's, keep the last one
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        r->ranges = false;
+    }
+    std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+    if (line.compare(0, 14, "accept-ranges:") == 0 && line.find("bytes") != std::string::npos) {
+        r->ranges = true;
+    }
+    return size * nitems;
+}
+
+static CURL* StartProbe(CURLM* multi, ProbeResult* r, Resolver* resolver) {
+    CURL* curl = Handles().Acquire();
+    curl_easy_setopt(curl, CURLOPT_URL, r->job->url.c_str());
+    if (resolver) {
+        resolver->Apply(curl, r->job->host, PortOf(r->job->url));
+    }
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ProbeHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, r);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, r);
+    curl_multi_add_handle(multi, curl);
+    return curl;
+}
+
+//longest a round waits on the probes alone while other transfers are driven too
+static const int driveSliceMs = 10;
+
+void ProbeJobs(std::vector<BatchJob>& jobs, int concurrency, Resolver* resolver, std::function<void(int)> drive) {
+    CURLM* multi = curl_multi_init();
+    std::vector<ProbeResult> results(jobs.size());
+    size_t next = 0;
+    int running = 0;
+    while (next < jobs.size() || running > 0) {
+        while (running < concurrency && next < jobs.size()) {
+            results[next].job = &jobs[next];
+            StartProbe(multi, &results[next], resolver);
+            next++;
+            running++;
+        }
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int queued = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL* curl = msg->easy_handle;
+            ProbeResult* r = NULL;
+            long status = 0;
+            curl_off_t length = -1;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&r);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+            if (msg->data.result == CURLE_OK && status < 400) {
+                r->job->size = length;
+                r->job->ranges = r->ranges;
+            }
+            curl_multi_remove_handle(multi, curl);
+            Handles().Release(curl);
+            running--;
+        }
+        //with free slots and probes left, go straight back to starting them
+        if (running > 0 && (running >= concurrency || next == jobs.size())) {
+            if (drive) {
+                //split the wait between the probes and the caller's transfers
+                curl_multi_poll(multi, NULL, 0, 0, NULL);
+                drive(driveSliceMs);
+            }
+            else {
+                curl_multi_poll(multi, NULL, 0, 1000, NULL);
+            }
+        }
+        else if (drive) {
+            drive(0);
+        }
+    }
+    curl_multi_cleanup(multi);
+}
+
+std::deque<BatchJob> PlanLpt(std::vector<BatchJob>& jobs, int slots, curl_off_t minSegment) {
+    curl_off_t total = 0;
+    for (BatchJob& job : jobs) {
+        if (job.size > 0) {
+            total += job.size;
+        }
+    }
+    curl_off_t share = total / (slots > 0 ? slots : 1);
+    if (share < minSegment) {
+        share = minSegment;
+    }
+
+    std::vector<BatchJob> pieces;
+    for (BatchJob& job : jobs) {
+        if (!job.ranges || job.size <= share) {
+            pieces.push_back(job);
+            continue;
+        }
+        int count = (int)((job.size + share - 1) / share);
+        if (count > slots) {
+            count = slots;
+        }
+        curl_off_t step = (job.size + count - 1) / count;
+        for (curl_off_t start = 0; start < job.size; start += step) {
+            BatchJob piece = job;
+            piece.rangeStart = start;
+            piece.rangeEnd = std::min(start + step, job.size) - 1;
+            piece.size = piece.rangeEnd - piece.rangeStart + 1;
+            pieces.push_back(piece);
+        }
+    }
+
+    //jobs of unknown size go first, they may well be the largest
+    std::stable_sort(pieces.begin(), pieces.end(), [](const BatchJob& a, const BatchJob& b) {
+        if ((a.size < 0) != (b.size < 0)) {
+            return a.size < 0;
+        }
+        return a.size > b.size;
+    });
+    return std::deque<BatchJob>(pieces.begin(), pieces.end());
+}
+
+curl_off_t PlannedMakespan(const std::deque<BatchJob>& queue, int slots) {
+    //each job goes to the slot that frees up first
+    std::priority_queue<curl_off_t, std::vector<curl_off_t>, std::greater<curl_off_t>> load;
+    for (int i = 0; i < slots; i++) {
+        load.push(0);
+    }
+    curl_off_t makespan = 0;
+    for (const BatchJob& job : queue) {
+        curl_off_t end = load.top() + (job.size > 0 ? job.size : 0);
+        load.pop();
+        load.push(end);
+        makespan = std::max(makespan, end);
+    }
+    return makespan;
+}
+
+bool PreallocateOutput(std::string path, curl_off_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = true;
+    if (size > 0) {
+        ok = SeekFile(file, size - 1) == 0 && fputc(0, file) != EOF;
+    }
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,633 @@
+#include <playlist.hpp>
+#include <util.hpp>
+#include <handlepool.hpp>
+#include <nettuning.hpp>
+#include <bufferpool.hpp>
+#include <iostream>
+#include <sstream>
+#include <deque>
+#include <cstdlib>
+#include <cmath>
+
+//value of NAME=value or NAME="value" in an attribute list
+static std::string TagAttr(std::string line, std::string name) {
+    size_t pos = 0;
+    while ((pos = line.find(name + "=", pos)) != std::string::npos) {
+        if (pos == 0 || line[pos - 1] == ',' || line[pos - 1] == ':' || line[pos - 1] == ' ') {
+            break;
+        }
+        pos++;
+    }
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += name.size() + 1;
+    if (pos < line.size() && line[pos] == '"') {
+        size_t end = line.find('"', pos + 1);
+        return line.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+    }
+    size_t end = line.find(',', pos);
+    return line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+//"length[@offset]" of EXT-X-BYTERANGE, the offset defaults to right after the previous range
+static void ByteRangeOf(std::string value, MediaSegment& seg, curl_off_t& next) {
+    curl_off_t length = strtoll(value.c_str(), NULL, 10);
+    size_t at = value.find('@');
+    curl_off_t offset = (at != std::string::npos) ? strtoll(value.c_str() + at + 1, NULL, 10) : next;
+    seg.rangeStart = offset;
+    seg.rangeEnd = offset + length - 1;
+    next = offset + length;
+}
+
+bool ParseM3u8(std::string text, std::string base, MediaPlaylist& playlist, std::string& variantUrl) {
+    std::istringstream lines(text);
+    std::string line;
+    if (!std::getline(lines, line) || line.compare(0, 7, "#EXTM3U") != 0) {
+        return false;
+    }
+    variantUrl = "";
+    playlist.segments.clear();
+    playlist.ended = false;
+    long long sequence = 0;
+    long long bestBandwidth = -1;
+    bool variantNext = false;
+    long long variantBandwidth = 0;
+    bool haveRange = false;
+    std::string range = "";
+    curl_off_t nextOffset = 0;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] == '#') {
+            if (line.compare(0, 18, "#EXT-X-STREAM-INF:") == 0) {
+                variantNext = true;
+                variantBandwidth = atoll(TagAttr(line, "BANDWIDTH").c_str());
+            }
+            else if (line.compare(0, 22, "#EXT-X-MEDIA-SEQUENCE:") == 0) {
+                sequence = atoll(line.c_str() + 22);
+            }
+            else if (line.compare(0, 22, "#EXT-X-TARGETDURATION:") == 0) {
+                playlist.targetDuration = atof(line.c_str() + 22);
+            }
+            else if (line.compare(0, 14, "#EXT-X-ENDLIST") == 0) {
+                playlist.ended = true;
+            }
+            else if (line.compare(0, 17, "#EXT-X-BYTERANGE:") == 0) {
+                haveRange = true;
+                range = line.substr(17);
+            }
+            else if (line.compare(0, 11, "#EXT-X-MAP:") == 0) {
+                playlist.init.url = ResolveUrl(base, TagAttr(line, "URI"));
+                std::string mapRange = TagAttr(line, "BYTERANGE");
+                if (mapRange != "") {
+                    curl_off_t unused = 0;
+                    ByteRangeOf(mapRange, playlist.init, unused);
+                }
+            }
+            else if (line.compare(0, 11, "#EXT-X-KEY:") == 0 && TagAttr(line, "METHOD") != "NONE") {
+                std::cout << "encrypted playlists are not supported" << std::endl;
+                return false;
+            }
+            continue;
+        }
+        if (variantNext) {
+            if (variantBandwidth > bestBandwidth) {
+                bestBandwidth = variantBandwidth;
+                variantUrl = ResolveUrl(base, line);
+            }
+            variantNext = false;
+            continue;
+        }
+        MediaSegment seg;
+        seg.url = ResolveUrl(base, line);
+        seg.sequence = sequence++;
+        if (haveRange) {
+            ByteRangeOf(range, seg, nextOffset);
+            haveRange = false;
+        }
+        playlist.segments.push_back(seg);
+    }
+    return true;
+}
+
+//start tag of the first <name ...> element at or after pos
+static size_t FindElement(const std::string& xml, std::string name, size_t pos, size_t end, std::string& tag) {
+    while ((pos = xml.find("<" + name, pos)) != std::string::npos && pos < end) {
+        char after = xml[pos + name.size() + 1];
+        if (after == ' ' || after == '>' || after == '/' || after == '\n' || after == '\t' || after == '\r') {
+            size_t close = xml.find('>', pos);
+            tag = xml.substr(pos, close - pos + 1);
+            return pos;
+        }
+        pos++;
+    }
+    return std::string::npos;
+}
+
+//end of the element whose start tag is at pos
+static size_t ElementEnd(const std::string& xml, std::string name, size_t pos, std::string& tag) {
+    if (tag.size() >= 2 && tag[tag.size() - 2] == '/') {
+        return pos + tag.size();
+    }
+    size_t end = xml.find("</" + name, pos);
+    return end == std::string::npos ? xml.size() : end;
+}
+
+static std::string XmlAttr(std::string tag, std::string name) {
+    size_t pos = 0;
+    while ((pos = tag.find(name + "=\"", pos)) != std::string::npos) {
+        if (pos > 0 && (tag[pos - 1] == ' ' || tag[pos - 1] == '\n' || tag[pos - 1] == '\t')) {
+            size_t end = tag.find('"', pos + name.size() + 2);
+            return tag.substr(pos + name.size() + 2, end - pos - name.size() - 2);
+        }
+        pos++;
+    }
+    return "";
+}
+
+static std::string XmlText(const std::string& xml, std::string name, size_t pos, size_t end) {
+    std::string tag;
+    size_t at = FindElement(xml, name, pos, end, tag);
+    if (at == std::string::npos) {
+        return "";
+    }
+    size_t start = at + tag.size();
+    size_t close = xml.find("</" + name, start);
+    std::string text = xml.substr(start, close - start);
+    text.erase(0, text.find_first_not_of(" \r\n\t"));
+    text.erase(text.find_last_not_of(" \r\n\t") + 1);
+    return text;
+}
+
+//ISO 8601 duration such as PT1H2M3.5S, in seconds
+static double IsoDuration(std::string value) {
+    double seconds = 0;
+    double number = 0;
+    bool time = false;
+    size_t i = 0;
+    while (i < value.size()) {
+        char c = value[i];
+        if (c == 'P') {
+            i++;
+            continue;
+        }
+        if (c == 'T') {
+            time = true;
+            i++;
+            continue;
+        }
+        char* end = NULL;
+        number = strtod(value.c_str() + i, &end);
+        i = end - value.c_str();
+        if (i >= value.size()) {
+            break;
+        }
+        char unit = value[i++];
+        if (unit == 'D') {
+            seconds += number * 86400;
+        }
+        else if (unit == 'H') {
+            seconds += number * 3600;
+        }
+        else if (unit == 'M') {
+            seconds += time ? number * 60 : number * 30 * 86400;
+        }
+        else if (unit == 'S') {
+            seconds += number;
+        }
+    }
+    return seconds;
+}
+
+//expands $RepresentationID$, $Bandwidth$, $Number$, $Time$ (with optional %0Nd widths)
+static std::string ExpandTemplate(std::string t, std::string id, std::string bandwidth, long long number, long long time) {
+    std::string out = "";
+    size_t pos = 0;
+    while (pos < t.size()) {
+        size_t start = t.find('$', pos);
+        if (start == std::string::npos) {
+            out += t.substr(pos);
+            break;
+        }
+        out += t.substr(pos, start - pos);
+        size_t end = t.find('$', start + 1);
+        if (end == std::string::npos) {
+            out += t.substr(start);
+            break;
+        }
+        std::string name = t.substr(start + 1, end - start - 1);
+        int width = 0;
+        size_t fmt = name.find("%0");
+        if (fmt != std::string::npos) {
+            width = atoi(name.c_str() + fmt + 2);
+            name = name.substr(0, fmt);
+        }
+        std::string value;
+        if (name == "") {
+            value = "$";
+        }
+        else if (name == "RepresentationID") {
+            value = id;
+        }
+        else if (name == "Bandwidth") {
+            value = bandwidth;
+        }
+        else if (name == "Number" || name == "Time") {
+            value = std::to_string(name == "Number" ? number : time);
+            while ((int)value.size() < width) {
+                value = "0" + value;
+            }
+        }
+        out += value;
+        pos = end + 1;
+    }
+    return out;
+}
+
+bool ParseMpd(std::string xml, std::string base, MediaPlaylist& playlist) {
+    std::string tag;
+    if (FindElement(xml, "MPD", 0, xml.size(), tag) == std::string::npos) {
+        return false;
+    }
+    if (XmlAttr(tag, "type") == "dynamic") {
+        std::cout << "live (dynamic) MPDs are not supported" << std::endl;
+        return false;
+    }
+    double total = IsoDuration(XmlAttr(tag, "mediaPresentationDuration"));
+    size_t period = FindElement(xml, "Period", 0, xml.size(), tag);
+    if (period == std::string::npos) {
+        return false;
+    }
+    std::string mpdBase = XmlText(xml, "BaseURL", 0, period);
+    if (mpdBase != "") {
+        base = ResolveUrl(base, mpdBase);
+    }
+    if (total <= 0) {
+        total = IsoDuration(XmlAttr(tag, "duration"));
+    }
+
+    //the first video adaptation set, or the first one at all
+    size_t setPos = std::string::npos;
+    size_t setEnd = 0;
+    std::string setTag;
+    for (size_t pos = period; (pos = FindElement(xml, "AdaptationSet", pos, xml.size(), tag)) != std::string::npos; pos++) {
+        std::string t = tag;
+        size_t end = ElementEnd(xml, "AdaptationSet", pos, t);
+        bool video = XmlAttr(tag, "contentType") == "video" || XmlAttr(tag, "mimeType").compare(0, 5, "video") == 0;
+        if (setPos == std::string::npos || video) {
+            setPos = pos;
+            setEnd = end;
+            setTag = tag;
+            if (video) {
+                break;
+            }
+        }
+    }
+    if (setPos == std::string::npos) {
+        return false;
+    }
+
+    //highest bandwidth representation
+    size_t repPos = std::string::npos;
+    size_t repEnd = 0;
+    std::string repTag;
+    long long best = -1;
+    for (size_t pos = setPos; (pos = FindElement(xml, "Representation", pos, setEnd, tag)) != std::string::npos; pos++) {
+        long long bandwidth = atoll(XmlAttr(tag, "bandwidth").c_str());
+        if (bandwidth > best) {
+            best = bandwidth;
+            repPos = pos;
+            repTag = tag;
+            std::string t = tag;
+            repEnd = ElementEnd(xml, "Representation", pos, t);
+        }
+    }
+    if (repPos == std::string::npos) {
+        return false;
+    }
+    std::string repBase = XmlText(xml, "BaseURL", repPos, repEnd);
+    if (repBase != "") {
+        base = ResolveUrl(base, repBase);
+    }
+    std::string id = XmlAttr(repTag, "id");
+    std::string bandwidth = XmlAttr(repTag, "bandwidth");
+    playlist.segments.clear();
+    playlist.ended = true;
+
+    //a SegmentList or SegmentTemplate on the representation wins over the adaptation set's
+    size_t scopes[2][2] = { { repPos, repEnd }, { setPos, setEnd } };
+    for (int s = 0; s < 2; s++) {
+        size_t from = scopes[s][0];
+        size_t to = scopes[s][1];
+        size_t list = FindElement(xml, "SegmentList", from, to, tag);
+        if (list != std::string::npos) {
+            std::string t = tag;
+            size_t listEnd = ElementEnd(xml, "SegmentList", list, t);
+            if (FindElement(xml, "Initialization", list, listEnd, tag) != std::string::npos) {
+                playlist.init.url = ResolveUrl(base, XmlAttr(tag, "sourceURL"));
+            }
+            long long n = 0;
+            for (size_t pos = list; (pos = FindElement(xml, "SegmentURL", pos, listEnd, tag)) != std::string::npos; pos++) {
+                MediaSegment seg;
+                seg.url = ResolveUrl(base, XmlAttr(tag, "media"));
+                seg.sequence = n++;
+                std::string range = XmlAttr(tag, "mediaRange");
+                if (range != "") {
+                    seg.rangeStart = strtoll(range.c_str(), NULL, 10);
+                    seg.rangeEnd = strtoll(range.c_str() + range.find('-') + 1, NULL, 10);
+                }
+                playlist.segments.push_back(seg);
+            }
+            return !playlist.segments.empty();
+        }
+        size_t tmpl = FindElement(xml, "SegmentTemplate", from, to, tag);
+        if (tmpl == std::string::npos) {
+            continue;
+        }
+        std::string tmplTag = tag;
+        std::string media = XmlAttr(tmplTag, "media");
+        std::string init = XmlAttr(tmplTag, "initialization");
+        long long number = XmlAttr(tmplTag, "startNumber") != "" ? atoll(XmlAttr(tmplTag, "startNumber").c_str()) : 1;
+        double timescale = XmlAttr(tmplTag, "timescale") != "" ? atof(XmlAttr(tmplTag, "timescale").c_str()) : 1;
+        if (init != "") {
+            playlist.init.url = ResolveUrl(base, ExpandTemplate(init, id, bandwidth, 0, 0));
+        }
+        std::string t = tmplTag;
+        size_t tmplEnd = ElementEnd(xml, "SegmentTemplate", tmpl, t);
+        size_t timeline = FindElement(xml, "SegmentTimeline", tmpl, tmplEnd, tag);
+        if (timeline != std::string::npos) {
+            long long time = 0;
+            for (size_t pos = timeline; (pos = FindElement(xml, "S", pos, tmplEnd, tag)) != std::string::npos; pos++) {
+                if (XmlAttr(tag, "t") != "") {
+                    time = atoll(XmlAttr(tag, "t").c_str());
+                }
+                long long d = atoll(XmlAttr(tag, "d").c_str());
+                long long r = atoll(XmlAttr(tag, "r").c_str());
+                for (long long i = 0; i <= r; i++) {
+                    MediaSegment seg;
+                    seg.url = ResolveUrl(base, ExpandTemplate(media, id, bandwidth, number, time));
+                    seg.sequence = number++;
+                    playlist.segments.push_back(seg);
+                    time += d;
+                }
+            }
+        }
+        else {
+            double duration = atof(XmlAttr(tmplTag, "duration").c_str());
+            if (duration <= 0 || total <= 0) {
+                return false;
+            }
+            long long count = (long long)ceil(total * timescale / duration);
+            for (long long i = 0; i < count; i++) {
+                MediaSegment seg;
+                seg.url = ResolveUrl(base, ExpandTemplate(media, id, bandwidth, number, (long long)(i * duration)));
+                seg.sequence = number++;
+                playlist.segments.push_back(seg);
+            }
+        }
+        return !playlist.segments.empty();
+    }
+    return false;
+}
+
+//loads the manifest at url, following a master playlist to its best variant
+static bool LoadPlaylist(CURL* curl, std::string url, MediaPlaylist& playlist) {
+    std::string text;
+    for (int depth = 0; depth < 2; depth++) {
+        if (!FetchText(curl, url, text)) {
+            std::cout << "error while fetching playlist " << url << std::endl;
+            return false;
+        }
+        char* effective = NULL;
+        curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective);
+        std::string base = effective ? effective : url;
+        playlist.url = url;
+        if (text.find("<MPD") != std::string::npos) {
+            return ParseMpd(text, base, playlist);
+        }
+        std::string variant;
+        if (!ParseM3u8(text, base, playlist, variant)) {
+            std::cout << "unrecognized playlist format" << std::endl;
+            return false;
+        }
+        if (variant == "") {
+            return true;
+        }
+        url = variant;
+    }
+    return false;
+}
+
+struct PendingSegment {
+    MediaSegment seg;
+    //the body, held until every segment before it is written
+    BufferChain data;
+    //the front of the queue never waits for buffer blocks
+    bool front = false;
+    //waiting for buffer blocks to be released
+    bool paused = false;
+    bool done = false;
+    int attempts = 0;
+    CURL* handle = NULL;
+};
+
+static size_t SegmentWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    PendingSegment* p = (PendingSegment*)ptr;
+    long status = 0;
+    curl_easy_getinfo(p->handle, CURLINFO_RESPONSE_CODE, &status);
+    if (p->seg.rangeStart >= 0 && status != 206) {
+        //the server ignored the byte range, don't take the whole resource as the segment
+        return 0;
+    }
+    if (!p->data.Append(data, size * nmemb, p->front)) {
+        //curl hands the same data again once resumed
+        p->paused = true;
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    return size * nmemb;
+}
+
+static void StartSegment(CURLM* multi, PendingSegment* p) {
+    p->data.Clear();
+    p->paused = false;
+    p->attempts++;
+    CURL* curl = Handles().Acquire();
+    p->handle = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, p->seg.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    if (p->seg.rangeStart >= 0) {
+        std::string range = std::to_string(p->seg.rangeStart) + "-" + std::to_string(p->seg.rangeEnd);
+        curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, SegmentWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, p);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, p);
+    curl_multi_add_handle(multi, curl);
+}
+
+bool DownloadPlaylist(std::string url, FILE* out, PlaylistOptions opts, PlaylistStats& stats) {
+    CURL* control = Handles().Acquire();
+    MediaPlaylist playlist;
+    if (!control || !LoadPlaylist(control, url, playlist)) {
+        if (control) {
+            Handles().Release(control);
+        }
+        return false;
+    }
+
+    //segments in playlist order; the front one is the next to be written
+    std::deque<PendingSegment*> queue;
+    long long lastSequence = -1;
+    auto append = [&](MediaPlaylist& p) {
+        for (MediaSegment& seg : p.segments) {
+            if (seg.sequence > lastSequence) {
+                PendingSegment* s = new PendingSegment();
+                s->seg = seg;
+                queue.push_back(s);
+                lastSequence = seg.sequence;
+            }
+        }
+    };
+    if (playlist.init.url != "") {
+        PendingSegment* s = new PendingSegment();
+        s->seg = playlist.init;
+        queue.push_back(s);
+    }
+    append(playlist);
+
+    CURLM* multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)opts.connections);
+    //next queue position to start, relative to the front
+    size_t next = 0;
+    std::deque<PendingSegment*> retry;
+    int running = 0;
+    int idleReloads = 0;
+    double nextReload = NowSeconds() + playlist.targetDuration;
+    bool ok = true;
+    while (ok) {
+        while (running < opts.connections) {
+            PendingSegment* s = NULL;
+            if (!retry.empty()) {
+                s = retry.front();
+                retry.pop_front();
+            }
+            else if (next < queue.size() && next < (size_t)opts.window) {
+                s = queue[next++];
+            }
+            else {
+                break;
+            }
+            StartSegment(multi, s);
+            running++;
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int queued = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            PendingSegment* s = NULL;
+            long status = 0;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&s);
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            Network().Record(msg->easy_handle);
+            Handles().Release(msg->easy_handle);
+            running--;
+            s->handle = NULL;
+            bool whole = s->seg.rangeStart < 0 ||
+                (status == 206 && (curl_off_t)s->data.Size() == s->seg.rangeEnd - s->seg.rangeStart + 1);
+            if (code == CURLE_OK && status < 400 && whole) {
+                s->done = true;
+            }
+            else if (s->seg.rangeStart >= 0 && status >= 200 && status < 300 && status != 206) {
+                std::cout << "segment " << s->seg.url << " failed: byte range not honoured (HTTP " << status << ")" << std::endl;
+                ok = false;
+            }
+            else if (s->attempts < 5) {
+                retry.push_back(s);
+            }
+            else {
+                std::cout << "segment " << s->seg.url << " failed" << std::endl;
+                ok = false;
+            }
+        }
+
+        //write out everything that is complete from the front
+        while (!queue.empty() && queue.front()->done) {
+            PendingSegment* s = queue.front();
+            for (size_t i = 0; i < s->data.Blocks(); i++) {
+                if (fwrite(s->data.Block(i), 1, s->data.BlockLength(i), out) != s->data.BlockLength(i)) {
+                    ok = false;
+                }
+            }
+            stats.segments++;
+            stats.bytes += s->data.Size();
+            if (opts.verbose) {
+                std::cout << "segment " << s->seg.sequence << " (" << s->data.Size() << " bytes)" << std::endl;
+            }
+            delete s;
+            queue.pop_front();
+            next--;
+        }
+        //segments paused for lack of buffer blocks go on as the writes free
+        //them; the front one is written as soon as it is done, so it never waits
+        for (size_t i = 0; i < next; i++) {
+            PendingSegment* s = queue[i];
+            s->front = i == 0;
+            if (s->handle && s->paused && (s->front || Buffers().Available())) {
+                s->paused = false;
+                curl_easy_pause(s->handle, CURLPAUSE_CONT);
+            }
+        }
+
+        double now = NowSeconds();
+        if (!playlist.ended && now >= nextReload) {
+            MediaPlaylist update;
+            stats.reloads++;
+            long long before = lastSequence;
+            if (LoadPlaylist(control, playlist.url, update)) {
+                append(update);
+                playlist.ended = update.ended;
+                playlist.targetDuration = update.targetDuration;
+            }
+            //an unchanged playlist is reloaded after half the target duration
+            idleReloads = (lastSequence == before) ? idleReloads + 1 : 0;
+            nextReload = now + (idleReloads > 0 ? playlist.targetDuration / 2 : playlist.targetDuration);
+            if (idleReloads >= opts.maxIdleReloads) {
+                std::cout << "live playlist stopped updating" << std::endl;
+                playlist.ended = true;
+            }
+        }
+        if (queue.empty() && running == 0 && playlist.ended) {
+            break;
+        }
+        int timeout = 1000;
+        if (!playlist.ended) {
+            timeout = std::max(0, std::min(timeout, (int)((nextReload - now) * 1000)));
+        }
+        curl_multi_poll(multi, NULL, 0, timeout, NULL);
+    }
+
+    for (PendingSegment* s : queue) {
+        if (s->handle) {
+            curl_multi_remove_handle(multi, s->handle);
+            Handles().Release(s->handle);
+        }
+        delete s;
+    }
+    curl_multi_cleanup(multi);
+    Handles().Release(control);
+    fflush(out);
+    return ok;
+}
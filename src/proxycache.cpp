@@ -0,0 +1,646 @@
+#include <proxycache.hpp>
+#include <handlepool.hpp>
+#include <nettuning.hpp>
+#include <sha256.hpp>
+#include <util.hpp>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+std::string DefaultProxyCache() {
+    return UserCachePath("proxy");
+}
+
+#ifdef __linux__
+static const size_t maxRequestHead = 64 * 1024;
+//a client connection idle this long is closed
+static const int idleTimeout = 60;
+//responses without freshness information but with a Last-Modified are reused
+//for a tenth of their age, up to a day
+static const time_t maxHeuristic = 24 * 3600;
+
+//head of a response as clients get it
+struct StoredHead {
+    std::string url;
+    std::string status = "HTTP/1.1 200 OK";
+    //end-to-end headers, "Name: value"
+    std::vector<std::string> headers;
+    time_t stored = 0;
+    time_t expires = 0;
+};
+
+//an upstream fetch, shared by every request for the url that came while it ran
+struct Fetch {
+    std::mutex lock;
+    std::condition_variable done;
+    bool finished = false;
+    StoredHead head;
+    //body file, "" for none
+    std::string body;
+    //the body isn't cached and goes away with the last request served from it
+    bool temporary = false;
+    bool fromCache = false;
+    std::string outcome = "MISS";
+    ~Fetch() {
+        if (temporary && body != "") {
+            remove(body.c_str());
+        }
+    }
+};
+
+struct ClientRequest {
+    std::string method;
+    std::string target;
+    std::string version;
+    std::vector<std::string> headers;
+    bool keepAlive = false;
+};
+
+static std::string Lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return s;
+}
+
+static std::string Trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return start == std::string::npos ? "" : s.substr(start, end - start + 1);
+}
+
+static std::string HeaderName(const std::string& header) {
+    return Lower(Trim(header.substr(0, header.find(':'))));
+}
+
+//value of a header, repeated ones joined with commas
+static std::string HeaderValue(const std::vector<std::string>& headers, const std::string& name) {
+    std::string value = "";
+    for (const std::string& h : headers) {
+        size_t colon = h.find(':');
+        if (colon != std::string::npos && HeaderName(h) == name) {
+            value += (value == "" ? "" : ", ") + Trim(h.substr(colon + 1));
+        }
+    }
+    return value;
+}
+
+//true if the Cache-Control value has the directive, with its argument in value
+static bool Directive(const std::string& cacheControl, const std::string& name, long* value = NULL) {
+    size_t pos = 0;
+    while (pos <= cacheControl.size()) {
+        size_t end = cacheControl.find(',', pos);
+        std::string item = Lower(Trim(cacheControl.substr(pos, end == std::string::npos ? std::string::npos : end - pos)));
+        size_t equals = item.find('=');
+        if (Trim(item.substr(0, equals)) == name) {
+            if (value) {
+                std::string argument = equals == std::string::npos ? "" : Trim(item.substr(equals + 1));
+                argument.erase(std::remove(argument.begin(), argument.end(), '"'), argument.end());
+                *value = argument == "" ? -1 : atol(argument.c_str());
+            }
+            return true;
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+static bool HopByHop(const std::string& name) {
+    static const char* names[] = {"connection", "keep-alive", "proxy-connection", "proxy-authenticate", "proxy-authorization",
+        "te", "trailer", "trailers", "transfer-encoding", "upgrade", "content-length", "age"};
+    for (const char* n : names) {
+        if (name == n) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool Storable(long status, const std::vector<std::string>& headers) {
+    std::string cacheControl = HeaderValue(headers, "cache-control");
+    return status == 200 && !Directive(cacheControl, "no-store") && !Directive(cacheControl, "private") &&
+        HeaderValue(headers, "vary") == "" && HeaderValue(headers, "set-cookie") == "";
+}
+
+//time the response stops being fresh, now if it must be revalidated on every use
+static time_t Expiry(const std::vector<std::string>& headers, time_t now) {
+    std::string cacheControl = HeaderValue(headers, "cache-control");
+    long age = 0;
+    if (Directive(cacheControl, "no-cache")) {
+        return now;
+    }
+    if ((Directive(cacheControl, "s-maxage", &age) || Directive(cacheControl, "max-age", &age)) && age >= 0) {
+        return now + age;
+    }
+    time_t date = curl_getdate(HeaderValue(headers, "date").c_str(), NULL);
+    if (date < 0) {
+        date = now;
+    }
+    std::string expires = HeaderValue(headers, "expires");
+    if (expires != "") {
+        time_t at = curl_getdate(expires.c_str(), NULL);
+        return at > date ? now + (at - date) : now;
+    }
+    time_t modified = curl_getdate(HeaderValue(headers, "last-modified").c_str(), NULL);
+    if (modified > 0 && modified < date) {
+        return now + std::min((date - modified) / 10, maxHeuristic);
+    }
+    return now;
+}
+
+static bool SendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+static size_t HeaderLine(char* data, size_t size, size_t count, void* userdata) {
+    StoredHead* head = (StoredHead*)userdata;
+    std::string line = Trim(std::string(data, size * count));
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        //a new response (after a 100 or an auth round) replaces the previous one
+        size_t space = line.find(' ');
+        head->status = "HTTP/1.1 " + (space == std::string::npos ? "502" : line.substr(space + 1));
+        head->headers.clear();
+    }
+    else if (line != "" && line.find(':') != std::string::npos && !HopByHop(HeaderName(line))) {
+        head->headers.push_back(line);
+    }
+    return size * count;
+}
+
+class ProxyCache {
+private:
+    ProxyOptions opts;
+    std::mutex lock;
+    //heads of the cached responses read so far, by key
+    std::map<std::string, StoredHead> entries;
+    std::map<std::string, std::shared_ptr<Fetch>> inflight;
+    std::atomic<long long> fetches;
+    std::mutex logLock;
+
+    std::string BodyPath(const std::string& key) {
+        return JoinPath(opts.cacheDir, key);
+    }
+
+    bool Lookup(const std::string& key, StoredHead& head) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            head = it->second;
+            return true;
+        }
+        std::ifstream in(BodyPath(key) + ".head");
+        std::string line;
+        if (!std::getline(in, head.url) || !(in >> head.stored >> head.expires) || !std::getline(in, line) || !std::getline(in, head.status)) {
+            return false;
+        }
+        head.headers.clear();
+        while (std::getline(in, line)) {
+            head.headers.push_back(line);
+        }
+        entries[key] = head;
+        return true;
+    }
+
+    void Store(const std::string& key, const StoredHead& head) {
+        std::string path = BodyPath(key) + ".head";
+        std::string tmp = path + ".part" + std::to_string(fetches++);
+        FILE* out = fopen(tmp.c_str(), "wb");
+        if (!out) {
+            return;
+        }
+        std::string data = head.url + "\n" + std::to_string((long long)head.stored) + " " + std::to_string((long long)head.expires) + "\n" + head.status + "\n";
+        for (const std::string& h : head.headers) {
+            data += h + "\n";
+        }
+        bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+        ok = fclose(out) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            remove(tmp.c_str());
+            return;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        entries[key] = head;
+    }
+
+    void Forget(const std::string& key) {
+        std::lock_guard<std::mutex> guard(lock);
+        entries.erase(key);
+    }
+
+    //fetches the url into a new body file. With a stale head it asks for a
+    //304 instead and keeps the cached body if that comes back
+    void Upstream(Fetch& fetch, const std::string& key, const ClientRequest& req, bool cacheable, const StoredHead* stale) {
+        std::string tmp = BodyPath(key) + ".part" + std::to_string(fetches++);
+        FILE* out = fopen(tmp.c_str(), "wb");
+        CURL* curl = out ? Handles().Acquire() : NULL;
+        if (!curl) {
+            if (out) {
+                fclose(out);
+                remove(tmp.c_str());
+            }
+            fetch.head.status = "HTTP/1.1 502 Bad Gateway";
+            fetch.outcome = "ERROR";
+            return;
+        }
+        struct curl_slist* headers = NULL;
+        for (const std::string& h : req.headers) {
+            std::string name = HeaderName(h);
+            //the whole body is fetched once for every client, conditions and ranges are theirs
+            if (!HopByHop(name) && name != "host" && name != "range" && name != "if-range" && name.compare(0, 3, "if-") != 0) {
+                headers = curl_slist_append(headers, h.c_str());
+            }
+        }
+        if (stale) {
+            std::string etag = HeaderValue(stale->headers, "etag");
+            std::string modified = HeaderValue(stale->headers, "last-modified");
+            if (etag != "") {
+                headers = curl_slist_append(headers, ("If-None-Match: " + etag).c_str());
+            }
+            if (modified != "") {
+                headers = curl_slist_append(headers, ("If-Modified-Since: " + modified).c_str());
+            }
+        }
+        StoredHead head;
+        head.url = req.target;
+        StallDetector detector(opts.stall);
+        curl_easy_setopt(curl, CURLOPT_URL, req.target.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, out);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderLine);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &head);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, StallXferInfo);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &detector);
+        CURLcode code = curl_easy_perform(curl);
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        Network().Record(curl);
+        Handles().Release(curl);
+        curl_slist_free_all(headers);
+        bool written = fclose(out) == 0;
+        time_t now = time(NULL);
+        if (code != CURLE_OK || !written || status == 0) {
+            remove(tmp.c_str());
+            fetch.head.status = "HTTP/1.1 502 Bad Gateway";
+            fetch.outcome = "ERROR";
+            return;
+        }
+        if (stale && status == 304) {
+            //the cached body is still good, the 304 brings its new freshness
+            remove(tmp.c_str());
+            StoredHead updated = *stale;
+            for (const std::string& h : head.headers) {
+                std::string name = HeaderName(h);
+                updated.headers.erase(std::remove_if(updated.headers.begin(), updated.headers.end(),
+                    [&name](const std::string& old) { return HeaderName(old) == name; }), updated.headers.end());
+            }
+            for (const std::string& h : head.headers) {
+                updated.headers.push_back(h);
+            }
+            updated.stored = now;
+            updated.expires = Expiry(updated.headers, now);
+            Store(key, updated);
+            fetch.head = updated;
+            fetch.body = BodyPath(key);
+            fetch.fromCache = true;
+            fetch.outcome = "REVALIDATED";
+            return;
+        }
+        head.stored = now;
+        head.expires = Expiry(head.headers, now);
+        fetch.head = head;
+        if (cacheable && Storable(status, head.headers) && rename(tmp.c_str(), BodyPath(key).c_str()) == 0) {
+            Store(key, head);
+            fetch.body = BodyPath(key);
+            return;
+        }
+        if (cacheable && stale) {
+            //the url changed into something that can't be kept
+            Forget(key);
+            remove((BodyPath(key) + ".head").c_str());
+        }
+        fetch.body = tmp;
+        fetch.temporary = true;
+        fetch.outcome = cacheable ? "MISS" : "BYPASS";
+    }
+
+    bool Respond(int fd, const ClientRequest& req, const Fetch& fetch, const std::string& outcome) {
+        int body = -1;
+        struct stat st;
+        st.st_size = 0;
+        if (fetch.body != "" && ((body = open(fetch.body.c_str(), O_RDONLY | O_CLOEXEC)) < 0 || fstat(body, &st) != 0)) {
+            if (body >= 0) {
+                close(body);
+            }
+            SendAll(fd, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return false;
+        }
+        std::string head = fetch.head.status + "\r\n";
+        for (const std::string& h : fetch.head.headers) {
+            head += h + "\r\n";
+        }
+        head += "Content-Length: " + std::to_string((long long)st.st_size) + "\r\n";
+        if (fetch.fromCache) {
+            head += "Age: " + std::to_string((long long)std::max<time_t>(0, time(NULL) - fetch.head.stored)) + "\r\n";
+        }
+        head += "X-Cache: " + outcome + "\r\n";
+        head += req.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        bool ok = SendAll(fd, head);
+        off_t offset = 0;
+        while (ok && body >= 0 && req.method == "GET" && offset < st.st_size) {
+            ssize_t n = sendfile(fd, body, &offset, st.st_size - offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = n > 0;
+        }
+        if (body >= 0) {
+            close(body);
+        }
+        if (opts.verbose) {
+            std::lock_guard<std::mutex> guard(logLock);
+            std::cout << outcome << " " << fetch.head.status.substr(9, 3) << " " << st.st_size << " " << req.target << std::endl;
+        }
+        return ok;
+    }
+
+    //relays the bytes of a CONNECT until either side closes
+    void Tunnel(int fd, const ClientRequest& req, const std::string& pending) {
+        std::string target = req.target;
+        size_t colon = target.rfind(':');
+        if (colon == std::string::npos || colon + 1 >= target.size()) {
+            SendAll(fd, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
+        std::string host = target.substr(0, colon);
+        std::string port = target.substr(colon + 1);
+        if (host.size() > 2 && host[0] == '[') {
+            host = host.substr(1, host.size() - 2);
+        }
+        struct addrinfo hints = {};
+        struct addrinfo* res = NULL;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int upstream = -1;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0) {
+            for (struct addrinfo* a = res; a && upstream < 0; a = a->ai_next) {
+                upstream = socket(a->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (upstream >= 0 && connect(upstream, a->ai_addr, a->ai_addrlen) != 0) {
+                    close(upstream);
+                    upstream = -1;
+                }
+            }
+            freeaddrinfo(res);
+        }
+        if (upstream < 0) {
+            SendAll(fd, "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
+        if (SendAll(fd, "HTTP/1.1 200 Connection established\r\n\r\n") && SendAll(upstream, pending)) {
+            struct pollfd p[2] = {{fd, POLLIN, 0}, {upstream, POLLIN, 0}};
+            char buffer[64 * 1024];
+            bool open = true;
+            while (open && poll(p, 2, idleTimeout * 1000) > 0) {
+                for (int i = 0; i < 2 && open; i++) {
+                    if (p[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                        ssize_t n = recv(p[i].fd, buffer, sizeof(buffer), 0);
+                        open = n > 0 && SendAll(p[1 - i].fd, std::string(buffer, n));
+                    }
+                }
+            }
+        }
+        if (opts.verbose) {
+            std::lock_guard<std::mutex> guard(logLock);
+            std::cout << "TUNNEL " << req.target << std::endl;
+        }
+        close(upstream);
+    }
+
+    //the next request head of the connection, false once it is closed or broken
+    bool ReadRequest(int fd, std::string& pending, ClientRequest& req) {
+        size_t end;
+        char buffer[16 * 1024];
+        while ((end = pending.find("\r\n\r\n")) == std::string::npos) {
+            if (pending.size() > maxRequestHead) {
+                return false;
+            }
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            pending.append(buffer, n);
+        }
+        std::string head = pending.substr(0, end);
+        pending.erase(0, end + 4);
+        size_t lineEnd = head.find("\r\n");
+        std::string line = head.substr(0, lineEnd);
+        size_t first = line.find(' ');
+        size_t second = line.find(' ', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            return false;
+        }
+        req.method = line.substr(0, first);
+        req.target = line.substr(first + 1, second - first - 1);
+        req.version = line.substr(second + 1);
+        req.headers.clear();
+        while (lineEnd != std::string::npos) {
+            size_t next = head.find("\r\n", lineEnd + 2);
+            std::string header = head.substr(lineEnd + 2, next == std::string::npos ? std::string::npos : next - lineEnd - 2);
+            if (header.find(':') != std::string::npos) {
+                req.headers.push_back(header);
+            }
+            lineEnd = next;
+        }
+        std::string connection = Lower(HeaderValue(req.headers, "connection") + "," + HeaderValue(req.headers, "proxy-connection"));
+        req.keepAlive = req.version == "HTTP/1.1" ? connection.find("close") == std::string::npos : connection.find("keep-alive") != std::string::npos;
+        //request bodies aren't read, the connection can't be reused after one
+        if (HeaderValue(req.headers, "transfer-encoding") != "" || atol(HeaderValue(req.headers, "content-length").c_str()) > 0) {
+            req.keepAlive = false;
+        }
+        return true;
+    }
+
+    //answers the request, false if the connection has to be closed
+    bool Serve(int fd, const ClientRequest& req, std::string& pending) {
+        if (req.method == "CONNECT") {
+            Tunnel(fd, req, pending);
+            return false;
+        }
+        std::string scheme = Lower(req.target.substr(0, req.target.find("://")));
+        if ((req.method != "GET" && req.method != "HEAD") || (scheme != "http" && scheme != "https")) {
+            SendAll(fd, "HTTP/1.1 501 Not Implemented\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return false;
+        }
+        std::string requestControl = HeaderValue(req.headers, "cache-control");
+        long maxAge = -1;
+        bool cacheable = HeaderValue(req.headers, "authorization") == "" && !Directive(requestControl, "no-store");
+        bool revalidate = Directive(requestControl, "no-cache") || Lower(HeaderValue(req.headers, "pragma")).find("no-cache") != std::string::npos ||
+            (Directive(requestControl, "max-age", &maxAge) && maxAge == 0);
+        Sha256 hash;
+        hash.Update(req.target.data(), req.target.size());
+        std::string key = hash.Final();
+        std::shared_ptr<Fetch> fetch;
+        if (!cacheable) {
+            fetch = std::make_shared<Fetch>();
+            Upstream(*fetch, key, req, false, NULL);
+            return Respond(fd, req, *fetch, fetch->outcome) && req.keepAlive;
+        }
+        StoredHead head;
+        //a head whose body is gone is no entry, a conditional request would get a 304 with nothing to send
+        bool cached = Lookup(key, head) && head.url == req.target && access(BodyPath(key).c_str(), R_OK) == 0;
+        if (cached && !revalidate && head.expires > time(NULL)) {
+            Fetch hit;
+            hit.head = head;
+            hit.body = BodyPath(key);
+            hit.fromCache = true;
+            hit.outcome = "HIT";
+            return Respond(fd, req, hit, hit.outcome) && req.keepAlive;
+        }
+        bool leader = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = inflight.find(key);
+            if (it != inflight.end()) {
+                fetch = it->second;
+            }
+            else {
+                fetch = std::make_shared<Fetch>();
+                inflight[key] = fetch;
+                leader = true;
+            }
+        }
+        if (leader) {
+            Upstream(*fetch, key, req, true, cached ? &head : NULL);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                inflight.erase(key);
+            }
+            std::lock_guard<std::mutex> guard(fetch->lock);
+            fetch->finished = true;
+            fetch->done.notify_all();
+        }
+        else {
+            std::unique_lock<std::mutex> wait(fetch->lock);
+            fetch->done.wait(wait, [&fetch] { return fetch->finished; });
+        }
+        //a request that waited for another one's fetch
+        std::string outcome = !leader && fetch->outcome == "MISS" ? "COLLAPSED" : fetch->outcome;
+        return Respond(fd, req, *fetch, outcome) && req.keepAlive;
+    }
+
+public:
+    ProxyCache(ProxyOptions _opts) : opts(_opts), fetches(0) {}
+
+    void Client(int fd) {
+        struct timeval timeout = {idleTimeout, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::string pending;
+        ClientRequest req;
+        while (ReadRequest(fd, pending, req) && Serve(fd, req, pending)) {
+        }
+        close(fd);
+    }
+};
+#endif
+
+bool RunProxyCache(ProxyOptions opts) {
+#ifdef __linux__
+    if (opts.cacheDir == "" || !MakeParentDirs(JoinPath(opts.cacheDir, "x"))) {
+        std::cout << "can't create the proxy cache directory " << opts.cacheDir << std::endl;
+        return false;
+    }
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)opts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 512) != 0) {
+        std::cout << "can't listen on port " << opts.port << std::endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    //bodies of fetches cut short by an earlier exit
+    std::vector<std::string> files;
+    ListFiles(opts.cacheDir, files);
+    for (const std::string& f : files) {
+        if (f.find(".part") != std::string::npos) {
+            remove(f.c_str());
+        }
+    }
+    std::cout << "proxy cache on 127.0.0.1:" << opts.port << ", cache in " << opts.cacheDir << std::endl;
+    //lives as long as the process, the client threads are never joined
+    ProxyCache* proxy = new ProxyCache(opts);
+    while (true) {
+        int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                //out of descriptors until some clients are done
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        std::thread([proxy, fd] { proxy->Client(fd); }).detach();
+    }
+    close(listener);
+    return false;
+#else
+    std::cout << "--proxy-cache is only available on linux" << std::endl;
+    (void)opts;
+    return false;
+#endif
+}
@@ -0,0 +1,457 @@
+#include <ranges.hpp>
+#include <util.hpp>
+#include <handlepool.hpp>
+#include <nettuning.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+bool ParseRanges(std::string list, std::vector<ByteRange>& ranges) {
+    ranges.clear();
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = list.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        std::string item = list.substr(pos, comma - pos);
+        size_t dash = item.find('-');
+        if (dash == std::string::npos || dash == 0 || dash + 1 >= item.size()) {
+            return false;
+        }
+        char* end = NULL;
+        curl_off_t a = strtoll(item.c_str(), &end, 10);
+        if (end != item.c_str() + dash) {
+            return false;
+        }
+        curl_off_t b = strtoll(item.c_str() + dash + 1, &end, 10);
+        if (*end != '\0' || b < a) {
+            return false;
+        }
+        ranges.push_back(std::make_pair(a, b));
+        pos = comma + 1;
+    }
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<ByteRange> merged;
+    for (ByteRange& r : ranges) {
+        if (!merged.empty() && r.first <= merged.back().second + 1) {
+            merged.back().second = std::max(merged.back().second, r.second);
+        }
+        else {
+            merged.push_back(r);
+        }
+    }
+    ranges = merged;
+    return !ranges.empty();
+}
+
+RangeOutput::RangeOutput(FILE* _out, bool _stream) {
+    out = _out;
+    stream = _stream;
+    blocked = false;
+}
+
+bool RangeOutput::Write(curl_off_t partStart, curl_off_t offset, const char* data, size_t len, bool force) {
+    blocked = false;
+    if (stream) {
+        //records have to be contiguous, hold the part until it's complete
+        if (!parts[partStart].Append(data, len, force)) {
+            blocked = true;
+            return false;
+        }
+        return true;
+    }
+    return SeekFile(out, offset) == 0 && fwrite(data, 1, len, out) == len;
+}
+
+bool RangeOutput::EndPart(curl_off_t partStart) {
+    if (!stream) {
+        return true;
+    }
+    BufferChain& data = parts[partStart];
+    unsigned char header[16];
+    unsigned long long values[2] = { (unsigned long long)partStart, (unsigned long long)data.Size() };
+    for (int v = 0; v < 2; v++) {
+        for (int i = 0; i < 8; i++) {
+            header[v * 8 + i] = (unsigned char)(values[v] >> (56 - 8 * i));
+        }
+    }
+    bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    for (size_t i = 0; ok && i < data.Blocks(); i++) {
+        ok = fwrite(data.Block(i), 1, data.BlockLength(i), out) == data.BlockLength(i);
+    }
+    parts.erase(partStart);
+    return ok;
+}
+
+void RangeOutput::DropPart(curl_off_t partStart) {
+    parts.erase(partStart);
+}
+
+void RangeOutput::DropIncomplete() {
+    parts.clear();
+}
+
+MultipartParser::MultipartParser(std::string boundary, RangeOutput* _output) {
+    state = State::Preamble;
+    delimiter = "\r\n--" + boundary;
+    //the first delimiter may come without the leading CRLF
+    pending = "\r\n";
+    partStart = 0;
+    partOffset = 0;
+    output = _output;
+    error = false;
+}
+
+static bool ParseContentRange(std::string value, curl_off_t& start, curl_off_t& end) {
+    size_t bytes = value.find("bytes");
+    if (bytes == std::string::npos) {
+        return false;
+    }
+    const char* p = value.c_str() + bytes + 5;
+    while (*p == ' ') {
+        p++;
+    }
+    char* next = NULL;
+    start = strtoll(p, &next, 10);
+    if (next == p || *next != '-') {
+        return false;
+    }
+    end = strtoll(next + 1, NULL, 10);
+    return end >= start;
+}
+
+bool MultipartParser::BodyPart() {
+    size_t pos = pending.find(delimiter);
+    size_t usable = (pos == std::string::npos) ? (pending.size() > delimiter.size() ? pending.size() - delimiter.size() : 0) : pos;
+    if (usable > 0) {
+        //the multipart response is the only transfer and holds one part at a
+        //time, it can't wait for blocks anyone else would free
+        if (!output->Write(partStart, partOffset, pending.data(), usable, true)) {
+            error = true;
+        }
+        partOffset += usable;
+        pending.erase(0, usable);
+    }
+    if (pos == std::string::npos) {
+        return false;
+    }
+    output->EndPart(partStart);
+    received.push_back(std::make_pair(partStart, partOffset - 1));
+    pending.erase(0, delimiter.size());
+    state = State::Headers;
+    return true;
+}
+
+void MultipartParser::Feed(const char* data, size_t len) {
+    pending.append(data, len);
+    bool progress = true;
+    while (progress && state != State::Done && !error) {
+        progress = false;
+        if (state == State::Preamble) {
+            size_t pos = pending.find(delimiter);
+            if (pos != std::string::npos) {
+                pending.erase(0, pos + delimiter.size());
+                state = State::Headers;
+                progress = true;
+            }
+            else if (pending.size() > delimiter.size()) {
+                pending.erase(0, pending.size() - delimiter.size());
+            }
+        }
+        else if (state == State::Headers) {
+            if (pending.size() >= 2 && pending.compare(0, 2, "--") == 0) {
+                state = State::Done;
+                break;
+            }
+            size_t end = pending.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                break;
+            }
+            std::string headers = pending.substr(0, end);
+            std::string lower = headers;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            size_t cr = lower.find("content-range:");
+            curl_off_t a = 0, b = 0;
+            if (cr == std::string::npos || !ParseContentRange(lower.substr(cr + 14), a, b)) {
+                error = true;
+                break;
+            }
+            partStart = a;
+            partOffset = a;
+            pending.erase(0, end + 4);
+            state = State::Body;
+            progress = true;
+        }
+        else if (state == State::Body) {
+            progress = BodyPart();
+        }
+    }
+}
+
+bool MultipartParser::Finished() {
+    return state == State::Done;
+}
+
+struct RangeRequest {
+    RangeOutput* output;
+    MultipartParser* parser = NULL;
+    //single part responses
+    curl_off_t partStart = -1;
+    curl_off_t partOffset = 0;
+    long status = 0;
+    std::string boundary;
+    bool writeError = false;
+    //ranges to cut out of a 200 with the whole file, and how far its body got
+    const std::vector<ByteRange>* cut = NULL;
+    size_t nextCut = 0;
+    curl_off_t bodyOffset = 0;
+    std::vector<ByteRange> received;
+    //the oldest running request, it never waits for buffer blocks
+    bool lead = false;
+    bool paused = false;
+    CURL* handle = NULL;
+};
+
+static size_t RangeHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    RangeRequest* r = (RangeRequest*)ptr;
+    std::string line(buffer, size * nitems);
+    std::string lower = line;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (lower.compare(0, 5, "http/") == 0) {
+        r->status = atol(line.c_str() + line.find(' '));
+        r->partStart = -1;
+        r->boundary = "";
+    }
+    else if (lower.compare(0, 14, "content-range:") == 0) {
+        curl_off_t a = 0, b = 0;
+        if (ParseContentRange(lower.substr(14), a, b)) {
+            r->partStart = a;
+            r->partOffset = a;
+        }
+    }
+    else if (lower.compare(0, 13, "content-type:") == 0 && lower.find("multipart/byteranges") != std::string::npos) {
+        size_t b = lower.find("boundary=");
+        if (b != std::string::npos) {
+            //the boundary is case sensitive, take it from the original line
+            std::string boundary = line.substr(b + 9);
+            boundary.erase(boundary.find_last_not_of(" \r\n") + 1);
+            if (boundary.size() >= 2 && boundary[0] == '"') {
+                boundary = boundary.substr(1, boundary.size() - 2);
+            }
+            r->boundary = boundary;
+        }
+    }
+    return size * nitems;
+}
+
+//a 200 carries the whole file: the ranges are cut out of it as it passes
+//and the transfer ends after the last one
+static size_t CutRanges(RangeRequest* r, const char* data, size_t len) {
+    const std::vector<ByteRange>& ranges = *r->cut;
+    curl_off_t at = r->bodyOffset;
+    curl_off_t end = at + (curl_off_t)len;
+    while (r->nextCut < ranges.size() && ranges[r->nextCut].first < end) {
+        const ByteRange& range = ranges[r->nextCut];
+        curl_off_t from = std::max(at, range.first);
+        curl_off_t to = std::min(end - 1, range.second);
+        //the only transfer, nobody else would free blocks for it
+        if (!r->output->Write(range.first, from, data + (from - at), (size_t)(to - from + 1), true)) {
+            r->writeError = true;
+            return 0;
+        }
+        if (to < range.second) {
+            break;
+        }
+        r->output->EndPart(range.first);
+        r->received.push_back(range);
+        r->nextCut++;
+    }
+    r->bodyOffset = end;
+    return r->nextCut < ranges.size() ? len : 0;
+}
+
+static size_t RangeWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    RangeRequest* r = (RangeRequest*)ptr;
+    size_t len = size * nmemb;
+    if (r->status == 200 && r->cut) {
+        return CutRanges(r, data, len);
+    }
+    if (r->status != 206) {
+        //the server sent the whole file, don't download it
+        return 0;
+    }
+    if (r->boundary != "") {
+        if (!r->parser) {
+            r->parser = new MultipartParser(r->boundary, r->output);
+        }
+        r->parser->Feed(data, len);
+        return r->parser->error ? 0 : len;
+    }
+    if (r->partStart < 0) {
+        r->writeError = true;
+        return 0;
+    }
+    if (!r->output->Write(r->partStart, r->partOffset, data, len, r->lead)) {
+        if (r->output->blocked) {
+            //out of buffer blocks, curl hands the same data again once resumed
+            r->paused = true;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        r->writeError = true;
+        return 0;
+    }
+    r->partOffset += len;
+    return len;
+}
+
+static std::string RangeHeaderValue(const std::vector<ByteRange>& ranges) {
+    std::string value = "";
+    for (int i = 0; i < ranges.size(); i++) {
+        if (i > 0) {
+            value += ",";
+        }
+        value += std::to_string(ranges[i].first) + "-" + std::to_string(ranges[i].second);
+    }
+    return value;
+}
+
+static CURL* RangeHandle(std::string url, std::string range, RangeRequest* r) {
+    CURL* curl = Handles().Acquire();
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, RangeHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, r);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, RangeWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, r);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, r);
+    return curl;
+}
+
+//requested ranges not covered by what was received
+static std::vector<ByteRange> Missing(std::vector<ByteRange>& wanted, std::vector<ByteRange> got) {
+    std::sort(got.begin(), got.end());
+    std::vector<ByteRange> missing;
+    for (ByteRange w : wanted) {
+        curl_off_t at = w.first;
+        for (ByteRange& g : got) {
+            if (g.second < at || g.first > w.second) {
+                continue;
+            }
+            if (g.first > at) {
+                missing.push_back(std::make_pair(at, g.first - 1));
+            }
+            at = std::max(at, g.second + 1);
+        }
+        if (at <= w.second) {
+            missing.push_back(std::make_pair(at, w.second));
+        }
+    }
+    return missing;
+}
+
+bool DownloadRanges(std::string url, std::vector<ByteRange> ranges, RangeOutput& output, int concurrency, RangeStats& stats) {
+    //one request for everything first
+    RangeRequest all;
+    all.output = &output;
+    all.cut = &ranges;
+    CURL* curl = RangeHandle(url, RangeHeaderValue(ranges), &all);
+    CURLcode code = curl_easy_perform(curl);
+    Network().Record(curl);
+    Handles().Release(curl);
+    stats.requests++;
+    if (all.status == 200) {
+        //no range support: asking again range by range would only get the
+        //whole file again, the ranges were cut out of this one
+        stats.wholeBody = true;
+        if (all.writeError || all.received.size() < ranges.size()) {
+            output.DropIncomplete();
+            std::cout << "server has no range support, and the body ended before the last range" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (all.status != 206) {
+        std::cout << "range request failed (HTTP " << all.status << ")" << std::endl;
+        return false;
+    }
+    std::vector<ByteRange> got;
+    if (all.parser) {
+        stats.multipart = true;
+        got = all.parser->received;
+        delete all.parser;
+    }
+    else if (code == CURLE_OK && all.partStart >= 0 && all.partOffset > all.partStart) {
+        //a single part, the server answered only the first range or merged them
+        output.EndPart(all.partStart);
+        got.push_back(std::make_pair(all.partStart, all.partOffset - 1));
+    }
+    std::vector<ByteRange> missing = Missing(ranges, got);
+    //a part cut off by the end of the response is refetched from its start,
+    //what was held of it would be written twice
+    output.DropIncomplete();
+
+    //whatever the first response didn't cover goes out as one request per range
+    CURLM* multi = curl_multi_init();
+    std::vector<RangeRequest> requests(missing.size());
+    size_t next = 0;
+    int running = 0;
+    bool ok = true;
+    while (next < missing.size() || running > 0) {
+        while (running < concurrency && next < missing.size()) {
+            requests[next].output = &output;
+            std::vector<ByteRange> one(1, missing[next]);
+            requests[next].handle = RangeHandle(url, RangeHeaderValue(one), &requests[next]);
+            curl_multi_add_handle(multi, requests[next].handle);
+            next++;
+            running++;
+        }
+        //requests paused for lack of buffer blocks go on as blocks are freed;
+        //the oldest one never waits, so some part always completes and frees its blocks
+        bool lead = true;
+        for (size_t i = 0; i < next; i++) {
+            RangeRequest& r = requests[i];
+            if (!r.handle) {
+                continue;
+            }
+            r.lead = lead;
+            lead = false;
+            if (r.paused && (r.lead || Buffers().Available())) {
+                r.paused = false;
+                curl_easy_pause(r.handle, CURLPAUSE_CONT);
+            }
+        }
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int queued = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            RangeRequest* r = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&r);
+            if (msg->data.result != CURLE_OK || r->status != 206 || r->partStart < 0) {
+                if (r->partStart >= 0) {
+                    output.DropPart(r->partStart);
+                }
+                ok = false;
+            }
+            else {
+                output.EndPart(r->partStart);
+            }
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            Network().Record(msg->easy_handle);
+            Handles().Release(msg->easy_handle);
+            r->handle = NULL;
+            stats.requests++;
+            running--;
+        }
+        curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+    curl_multi_cleanup(multi);
+    return ok;
+}
@@ -0,0 +1,446 @@
+#include <resolver.hpp>
+#include <util.hpp>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+//queries in flight at once, every host takes two (A and AAAA)
+static const size_t maxInFlight = 256;
+static const double queryTimeout = 1.0;
+static const int maxAttempts = 3;
+//how long an answer of the system resolver is kept, it doesn't tell the TTL
+static const time_t systemTtl = 60;
+//longest an answer is kept, whatever TTL the nameserver gives it
+static const uint32_t maxTtl = 86400;
+enum : uint16_t { TypeA = 1, TypeAAAA = 28 };
+
+Resolver::Resolver() : queries(0), cached(0), dirty(false) {}
+
+Resolver::~Resolver() {
+    for (auto& l : lists) {
+        curl_slist_free_all(l.second);
+    }
+    for (curl_slist* l : retired) {
+        curl_slist_free_all(l);
+    }
+}
+
+//the address of an ip literal, without the brackets of ipv6 in urls
+static bool IsAddress(std::string host) {
+    if (host.size() > 1 && host[0] == '[') {
+        host = host.substr(1, host.size() - 2);
+    }
+    unsigned char buf[16];
+    return inet_pton(AF_INET, host.c_str(), buf) == 1 || inet_pton(AF_INET6, host.c_str(), buf) == 1;
+}
+
+bool Resolver::Open(std::string file, std::string nameserver) {
+    cacheFile = file;
+    server = nameserver;
+    //names of the hosts file stay with the system resolver
+    std::ifstream hostsFile("/etc/hosts");
+    std::string line;
+    while (std::getline(hostsFile, line)) {
+        std::istringstream fields(line.substr(0, line.find('#')));
+        std::string name;
+        fields >> name;
+        while (fields >> name) {
+            local.insert(name);
+        }
+    }
+#ifdef __linux__
+    if (server == "") {
+        std::ifstream conf("/etc/resolv.conf");
+        while (std::getline(conf, line)) {
+            std::istringstream fields(line);
+            std::string key;
+            if (fields >> key && key == "nameserver" && fields >> server) {
+                break;
+            }
+        }
+    }
+#endif
+    if (cacheFile == "") {
+        return true;
+    }
+    std::ifstream in(cacheFile);
+    if (!in) {
+        //a first run starts without one
+        FILE* f = fopen(cacheFile.c_str(), "a");
+        if (!f) {
+            return false;
+        }
+        fclose(f);
+        return true;
+    }
+    time_t now = time(NULL);
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string host;
+        long long expires;
+        if (!(fields >> host >> expires) || expires <= now) {
+            continue;
+        }
+        ResolvedHost r;
+        r.expires = (time_t)std::min<long long>(expires, now + maxTtl);
+        std::string addr;
+        while (fields >> addr) {
+            r.addresses.push_back(addr);
+        }
+        if (!r.addresses.empty()) {
+            hosts[host] = r;
+            cached++;
+        }
+    }
+    return true;
+}
+
+#ifdef __linux__
+struct Lookup {
+    std::string host;
+    std::vector<std::string> addresses;
+    uint32_t ttl = UINT32_MAX;
+};
+
+struct PendingQuery {
+    size_t lookup;
+    std::string packet;
+    int attempts = 0;
+    double sent = 0;
+};
+
+static std::string EncodeQuery(uint16_t id, const std::string& host, uint16_t type) {
+    std::string q;
+    const unsigned char header[12] = { (unsigned char)(id >> 8), (unsigned char)id, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };
+    q.append((const char*)header, sizeof(header));
+    size_t start = 0;
+    while (start < host.size()) {
+        size_t dot = host.find('.', start);
+        if (dot == std::string::npos) {
+            dot = host.size();
+        }
+        if (dot - start > 63) {
+            return "";
+        }
+        q += (char)(dot - start);
+        q.append(host, start, dot - start);
+        start = dot + 1;
+    }
+    q += '\0';
+    q += (char)(type >> 8);
+    q += (char)type;
+    q += '\0';
+    q += '\1';
+    return q;
+}
+
+//moves past a name at p, false if it runs past the message
+static bool SkipName(const unsigned char* msg, size_t len, size_t& p) {
+    while (p < len) {
+        unsigned char l = msg[p];
+        if (l == 0) {
+            p++;
+            return true;
+        }
+        if ((l & 0xc0) == 0xc0) {
+            p += 2;
+            return p <= len;
+        }
+        p += l + 1;
+    }
+    return false;
+}
+
+//true if the response asks the one question of the query, names compared
+//without regard to case
+static bool SameQuestion(const unsigned char* msg, size_t len, const std::string& query) {
+    if (((msg[4] << 8) | msg[5]) != 1 || len < query.size()) {
+        return false;
+    }
+    for (size_t i = 12; i < query.size(); i++) {
+        if (tolower(msg[i]) != tolower((unsigned char)query[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//collects the A and AAAA records of the answer section and their lowest TTL
+static void ParseAnswer(const unsigned char* msg, size_t len, Lookup& l) {
+    size_t p = 12;
+    int questions = (msg[4] << 8) | msg[5];
+    int answers = (msg[6] << 8) | msg[7];
+    for (int i = 0; i < questions; i++) {
+        if (!SkipName(msg, len, p) || (p += 4) > len) {
+            return;
+        }
+    }
+    for (int i = 0; i < answers; i++) {
+        if (!SkipName(msg, len, p) || p + 10 > len) {
+            return;
+        }
+        uint16_t type = (msg[p] << 8) | msg[p + 1];
+        uint32_t ttl = ((uint32_t)msg[p + 4] << 24) | ((uint32_t)msg[p + 5] << 16) | ((uint32_t)msg[p + 6] << 8) | msg[p + 7];
+        size_t rdlen = (msg[p + 8] << 8) | msg[p + 9];
+        p += 10;
+        if (p + rdlen > len) {
+            return;
+        }
+        char buf[INET6_ADDRSTRLEN];
+        std::string addr;
+        if (type == TypeA && rdlen == 4 && inet_ntop(AF_INET, msg + p, buf, sizeof(buf))) {
+            addr = buf;
+        }
+        else if (type == TypeAAAA && rdlen == 16 && inet_ntop(AF_INET6, msg + p, buf, sizeof(buf))) {
+            //curl wants ipv6 addresses in brackets
+            addr = std::string("[") + buf + "]";
+        }
+        if (addr != "") {
+            l.addresses.push_back(addr);
+            l.ttl = std::min(l.ttl, ttl);
+        }
+        p += rdlen;
+    }
+}
+
+//"ip", "ip:port" or "[ipv6]:port" of the nameserver
+static bool ServerAddress(std::string server, sockaddr_storage& addr, socklen_t& addrLen) {
+    int port = 53;
+    std::string ip = server;
+    if (server.size() > 0 && server[0] == '[') {
+        size_t end = server.find(']');
+        if (end == std::string::npos) {
+            return false;
+        }
+        ip = server.substr(1, end - 1);
+        if (end + 1 < server.size() && server[end + 1] == ':') {
+            port = atoi(server.c_str() + end + 2);
+        }
+    }
+    else if (server.find(':') != std::string::npos && server.find(':') == server.rfind(':')) {
+        ip = server.substr(0, server.find(':'));
+        port = atoi(server.c_str() + server.find(':') + 1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_in* v4 = (sockaddr_in*)&addr;
+    sockaddr_in6* v6 = (sockaddr_in6*)&addr;
+    if (inet_pton(AF_INET, ip.c_str(), &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        addrLen = sizeof(*v4);
+        return true;
+    }
+    if (inet_pton(AF_INET6, ip.c_str(), &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        addrLen = sizeof(*v6);
+        return true;
+    }
+    return false;
+}
+
+//asks the nameserver for every host at once, over one udp socket. Hosts
+//without an answer after the last attempt are left to curl's own resolver
+void Resolver::Query(const std::vector<std::string>& names) {
+    sockaddr_storage addr;
+    socklen_t addrLen;
+    if (!ServerAddress(server, addr, addrLen)) {
+        return;
+    }
+    int fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return;
+    }
+    if (connect(fd, (sockaddr*)&addr, addrLen) != 0) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    static std::mt19937 random(std::random_device{}());
+    std::vector<Lookup> lookups(names.size());
+    std::map<uint16_t, PendingQuery> inFlight;
+    size_t next = 0;
+    auto transmit = [&](PendingQuery& q) {
+        q.attempts++;
+        q.sent = NowSeconds();
+        ::send(fd, q.packet.data(), q.packet.size(), 0);
+    };
+    while (next < lookups.size() * 2 || !inFlight.empty()) {
+        while (inFlight.size() < maxInFlight && next < lookups.size() * 2) {
+            size_t i = next / 2;
+            uint16_t type = next % 2 == 0 ? TypeA : TypeAAAA;
+            next++;
+            lookups[i].host = names[i];
+            //a fresh random id for every query, a spoofed answer has to guess it
+            uint16_t id;
+            do {
+                id = (uint16_t)random();
+            } while (inFlight.count(id));
+            PendingQuery q;
+            q.lookup = i;
+            q.packet = EncodeQuery(id, names[i], type);
+            if (q.packet == "") {
+                continue;
+            }
+            transmit(inFlight[id] = q);
+            queries++;
+        }
+        pollfd p = { fd, POLLIN, 0 };
+        poll(&p, 1, 50);
+        unsigned char msg[4096];
+        ssize_t len;
+        while ((len = recv(fd, msg, sizeof(msg), 0)) >= 12) {
+            auto q = inFlight.find((uint16_t)((msg[0] << 8) | msg[1]));
+            //only responses to a query in flight that ask its question, a truncated one doesn't count
+            if (q == inFlight.end() || !(msg[2] & 0x80) || (msg[2] & 0x02) || !SameQuestion(msg, (size_t)len, q->second.packet)) {
+                continue;
+            }
+            if ((msg[3] & 0x0f) == 0) {
+                ParseAnswer(msg, (size_t)len, lookups[q->second.lookup]);
+            }
+            inFlight.erase(q);
+        }
+        //nothing listens on the nameserver's port, curl resolves them all
+        if (len < 0 && errno == ECONNREFUSED) {
+            break;
+        }
+        double now = NowSeconds();
+        for (auto q = inFlight.begin(); q != inFlight.end();) {
+            if (now - q->second.sent < queryTimeout) {
+                q++;
+            }
+            else if (q->second.attempts < maxAttempts) {
+                transmit(q->second);
+                q++;
+            }
+            else {
+                q = inFlight.erase(q);
+            }
+        }
+    }
+    close(fd);
+    time_t now = time(NULL);
+    for (Lookup& l : lookups) {
+        if (l.addresses.empty()) {
+            continue;
+        }
+        ResolvedHost& r = hosts[l.host];
+        r.addresses = l.addresses;
+        r.expires = now + std::min(std::max<uint32_t>(l.ttl, 1), maxTtl);
+        dirty = true;
+    }
+}
+#else
+//no nonblocking client here, the system resolver answers one host after the other
+void Resolver::Query(const std::vector<std::string>& names) {
+    time_t now = time(NULL);
+    for (const std::string& host : names) {
+        queries++;
+        std::vector<std::string> addresses = ResolveAddresses(host);
+        if (!addresses.empty()) {
+            hosts[host].addresses = addresses;
+            hosts[host].expires = now + systemTtl;
+            dirty = true;
+        }
+    }
+}
+#endif
+
+void Resolver::Prefetch(const std::vector<std::string>& names) {
+    time_t now = time(NULL);
+    std::vector<std::string> missing;
+    std::set<std::string> seen;
+    for (const std::string& host : names) {
+        //single labels go through the search domains of the system resolver
+        if (host == "" || IsAddress(host) || host.find('.') == std::string::npos || local.count(host) || !seen.insert(host).second) {
+            continue;
+        }
+        auto h = hosts.find(host);
+        if (h == hosts.end() || h->second.expires <= now) {
+            missing.push_back(host);
+        }
+    }
+    if (!missing.empty()) {
+        Query(missing);
+    }
+}
+
+void Resolver::Apply(CURL* curl, const std::string& host, long port) {
+    auto h = hosts.find(host);
+    if (h == hosts.end() || h->second.expires <= time(NULL)) {
+        return;
+    }
+    std::string key = host + ":" + std::to_string(port);
+    std::string entry = key + ":";
+    for (size_t i = 0; i < h->second.addresses.size(); i++) {
+        entry += (i > 0 ? "," : "") + h->second.addresses[i];
+    }
+    curl_slist*& list = lists[key];
+    if (!list || entry != list->data) {
+        //transfers started with the old list may still read it
+        if (list) {
+            retired.push_back(list);
+        }
+        list = curl_slist_append(NULL, entry.c_str());
+    }
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, list);
+}
+
+bool Resolver::Save() {
+    if (cacheFile == "" || !dirty) {
+        return true;
+    }
+    std::string temp = cacheFile + ".tmp";
+    FILE* f = fopen(temp.c_str(), "w");
+    if (!f) {
+        return false;
+    }
+    time_t now = time(NULL);
+    for (auto& h : hosts) {
+        if (h.second.expires <= now) {
+            continue;
+        }
+        fprintf(f, "%s %lld", h.first.c_str(), (long long)h.second.expires);
+        for (std::string& a : h.second.addresses) {
+            fprintf(f, " %s", a.c_str());
+        }
+        fputc('\n', f);
+    }
+    if (fclose(f) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+#ifndef __linux__
+    remove(cacheFile.c_str());
+#endif
+    if (rename(temp.c_str(), cacheFile.c_str()) != 0) {
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+long long Resolver::Queries() const {
+    return queries;
+}
+
+long long Resolver::Cached() const {
+    return cached;
+}
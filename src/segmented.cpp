@@ -0,0 +1,276 @@
+#include <segmented.hpp>
+#include <plan.hpp>
+#include <util.hpp>
+#include <bufferpool.hpp>
+#include <handlepool.hpp>
+#include <nettuning.hpp>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+struct Chunk {
+    curl_off_t start = 0;
+    curl_off_t end = 0;
+    //bytes of the chunk already written to the output
+    curl_off_t written = 0;
+    //bytes received ahead of the read head, not written yet
+    BufferChain buffer;
+    bool active = false;
+    //waiting for buffer blocks to be released
+    bool paused = false;
+    bool done = false;
+    int attempts = 0;
+    CURL* handle = NULL;
+};
+
+struct SegmentedDownload {
+    FILE* out;
+    bool ordered;
+    SegmentOptions opts;
+    std::vector<Chunk> chunks;
+    //first chunk not completely written yet (ordered mode)
+    size_t head = 0;
+    size_t nextChunk = 0;
+    //chunks that failed and go out again before any new one
+    std::deque<size_t> retry;
+    bool writeError = false;
+};
+
+struct ChunkTransfer {
+    SegmentedDownload* d;
+    size_t index;
+    //the range asked for, and what the response says it holds
+    curl_off_t from = 0;
+    long status = 0;
+    curl_off_t rangeStart = -1;
+    curl_off_t rangeEnd = -1;
+    //the response wasn't the range asked for, nothing of it was written
+    bool rejected = false;
+};
+
+//the server is busy or broken for now, another attempt may get the range
+static bool IsRetryable(long status) {
+    return status >= 500 || status == 408 || status == 429;
+}
+
+static size_t ChunkHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    ChunkTransfer* t = (ChunkTransfer*)ptr;
+    std::string line(buffer, size * nitems);
+    std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+    if (line.compare(0, 5, "http/") == 0) {
+        t->status = atol(line.c_str() + line.find(' '));
+        t->rangeStart = -1;
+        t->rangeEnd = -1;
+    }
+    else if (line.compare(0, 14, "content-range:") == 0) {
+        size_t bytes = line.find("bytes");
+        if (bytes != std::string::npos) {
+            char* dash = NULL;
+            t->rangeStart = strtoll(line.c_str() + bytes + 5, &dash, 10);
+            t->rangeEnd = *dash == '-' ? strtoll(dash + 1, NULL, 10) : -1;
+        }
+    }
+    return size * nitems;
+}
+
+static bool Emit(SegmentedDownload* d, Chunk& c, const char* data, size_t len) {
+    if (!d->ordered && SeekFile(d->out, c.start + c.written) != 0) {
+        return false;
+    }
+    if (fwrite(data, 1, len, d->out) != len) {
+        return false;
+    }
+    c.written += len;
+    return true;
+}
+
+//writes everything that is contiguous from the read head
+static void AdvanceHead(SegmentedDownload* d) {
+    while (d->head < d->chunks.size()) {
+        Chunk& c = d->chunks[d->head];
+        for (size_t i = 0; i < c.buffer.Blocks(); i++) {
+            if (!Emit(d, c, c.buffer.Block(i), c.buffer.BlockLength(i))) {
+                d->writeError = true;
+            }
+        }
+        c.buffer.Clear();
+        if (!c.done) {
+            break;
+        }
+        d->head++;
+    }
+}
+
+static size_t ChunkWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    ChunkTransfer* t = (ChunkTransfer*)ptr;
+    SegmentedDownload* d = t->d;
+    Chunk& c = d->chunks[t->index];
+    size_t len = size * nmemb;
+    //a whole body or an error page can't be taken back out of a pipe,
+    //only the exact range asked for gets through
+    if (t->status != 206 || t->rangeStart != t->from || t->rangeEnd != c.end) {
+        t->rejected = true;
+        return 0;
+    }
+    if (d->ordered && t->index != d->head) {
+        //running ahead of the head, hold on to it until it's our turn
+        if (!c.buffer.Append(data, len)) {
+            c.paused = true;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        return len;
+    }
+    return Emit(d, c, data, len) ? len : 0;
+}
+
+static void StartChunk(CURLM* multi, SegmentedDownload& d, std::string url, size_t index) {
+    Chunk& c = d.chunks[index];
+    c.active = true;
+    c.attempts++;
+    ChunkTransfer* t = new ChunkTransfer();
+    t->d = &d;
+    t->index = index;
+    //resume after whatever the chunk already has
+    t->from = c.start + c.written + (curl_off_t)c.buffer.Size();
+    std::string range = std::to_string(t->from) + "-" + std::to_string(c.end);
+    CURL* curl = Handles().Acquire();
+    c.handle = curl;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ChunkHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, t);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ChunkWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, t);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    curl_multi_add_handle(multi, curl);
+}
+
+SegmentResult DownloadSegmented(std::string url, FILE* out, bool ordered, SegmentOptions opts) {
+    std::vector<BatchJob> probe(1);
+    probe[0].url = url;
+    ProbeJobs(probe, 1);
+    if (!probe[0].ranges || probe[0].size <= 0) {
+        return SegmentResult::Unsupported;
+    }
+
+    SegmentedDownload d;
+    d.out = out;
+    d.ordered = ordered;
+    d.opts = opts;
+    for (curl_off_t start = 0; start < probe[0].size; start += opts.chunkSize) {
+        Chunk c;
+        c.start = start;
+        c.end = std::min(start + opts.chunkSize, probe[0].size) - 1;
+        d.chunks.push_back(std::move(c));
+    }
+    //how many chunks may be in flight or buffered past the head
+    size_t window = (size_t)(opts.memoryCap / opts.chunkSize);
+    if (window < (size_t)opts.connections) {
+        window = opts.connections;
+    }
+
+    CURLM* multi = curl_multi_init();
+    int running = 0;
+    bool failed = false;
+    while (!failed && (d.head < d.chunks.size() || running > 0)) {
+        while (running < opts.connections) {
+            size_t index;
+            if (!d.retry.empty()) {
+                index = d.retry.front();
+                d.retry.pop_front();
+            }
+            else if (d.nextChunk < d.chunks.size() && (!ordered || d.nextChunk < d.head + window)) {
+                index = d.nextChunk++;
+            }
+            else {
+                break;
+            }
+            StartChunk(multi, d, url, index);
+            running++;
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int queued = 0;
+        CURLMsg* msg;
+        while ((msg = curl_multi_info_read(multi, &queued))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL* curl = msg->easy_handle;
+            ChunkTransfer* t = NULL;
+            long status = 0;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&t);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            CURLcode code = msg->data.result;
+            curl_multi_remove_handle(multi, curl);
+            Network().Record(curl);
+            Handles().Release(curl);
+            running--;
+
+            Chunk& c = d.chunks[t->index];
+            c.active = false;
+            c.paused = false;
+            c.handle = NULL;
+            curl_off_t have = c.written + (curl_off_t)c.buffer.Size();
+            if (code == CURLE_OK && status == 206 && have == c.end - c.start + 1) {
+                c.done = true;
+            }
+            else if (c.attempts >= opts.maxAttempts || d.writeError ||
+                (t->rejected && (t->status == 206 || !IsRetryable(t->status))) ||
+                (code == CURLE_OK && status != 206 && !IsRetryable(status))) {
+                std::cerr << "chunk " << c.start << "-" << c.end << " failed" << std::endl;
+                failed = true;
+            }
+            else {
+                //the head chunk is what the consumer waits on, send it first
+                if (t->index == d.head) {
+                    d.retry.push_front(t->index);
+                }
+                else {
+                    d.retry.push_back(t->index);
+                }
+            }
+            delete t;
+        }
+        if (ordered) {
+            AdvanceHead(&d);
+        }
+        else {
+            while (d.head < d.chunks.size() && d.chunks[d.head].done) {
+                d.head++;
+            }
+        }
+        //chunks paused for lack of buffer blocks go on in order as the head
+        //frees them; the head itself never waits, it is written straight out
+        for (size_t i = d.head; ordered && i < d.nextChunk; i++) {
+            Chunk& c = d.chunks[i];
+            if (c.paused && (i == d.head || Buffers().Available())) {
+                c.paused = false;
+                curl_easy_pause(c.handle, CURLPAUSE_CONT);
+            }
+        }
+        if (d.writeError) {
+            failed = true;
+        }
+        curl_multi_poll(multi, NULL, 0, 1000, NULL);
+    }
+
+    //abandon whatever is still running after a failure
+    for (Chunk& c : d.chunks) {
+        if (c.handle) {
+            ChunkTransfer* t = NULL;
+            curl_easy_getinfo(c.handle, CURLINFO_PRIVATE, (char**)&t);
+            curl_multi_remove_handle(multi, c.handle);
+            Handles().Release(c.handle);
+            delete t;
+        }
+    }
+    curl_multi_cleanup(multi);
+    fflush(out);
+    return failed ? SegmentResult::Failed : SegmentResult::Ok;
+}
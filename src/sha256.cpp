@@ -0,0 +1,157 @@
+#include <sha256.hpp>
+#include <cstdio>
+#include <cstring>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t Rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+Sha256::Sha256() : blockLen(0), length(0) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, init, sizeof(state));
+}
+
+void Sha256::Transform(const unsigned char* p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) | ((uint32_t)p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void Sha256::Update(const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    length += len;
+    if (blockLen > 0) {
+        size_t take = len < 64 - blockLen ? len : 64 - blockLen;
+        memcpy(block + blockLen, p, take);
+        blockLen += take;
+        p += take;
+        len -= take;
+        if (blockLen < 64) {
+            return;
+        }
+        Transform(block);
+        blockLen = 0;
+    }
+    //whole blocks straight from the input
+    while (len >= 64) {
+        Transform(p);
+        p += 64;
+        len -= 64;
+    }
+    memcpy(block, p, len);
+    blockLen = len;
+}
+
+std::string Sha256::Final() {
+    uint64_t bits = length * 8;
+    unsigned char pad = 0x80;
+    Update(&pad, 1);
+    pad = 0;
+    while (blockLen != 56) {
+        Update(&pad, 1);
+    }
+    unsigned char tail[8];
+    for (int i = 0; i < 8; i++) {
+        tail[i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+    Update(tail, 8);
+    static const char* digits = "0123456789abcdef";
+    std::string hex;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 28; j >= 0; j -= 4) {
+            hex += digits[(state[i] >> j) & 0xf];
+        }
+    }
+    return hex;
+}
+
+bool Sha256File(std::string path, std::string& hex) {
+    Sha256 sha;
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0) {
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+        sha.Update(data, (size_t)st.st_size);
+        munmap(data, (size_t)st.st_size);
+    }
+    close(fd);
+#else
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    std::string buffer(1024 * 1024, '\0');
+    size_t got;
+    while ((got = fread(&buffer[0], 1, buffer.size(), file)) > 0) {
+        sha.Update(buffer.data(), got);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) {
+        return false;
+    }
+#endif
+    hex = sha.Final();
+    return true;
+}
@@ -0,0 +1,345 @@
+#include <splicefetch.hpp>
+#include <util.hpp>
+#include <nettuning.hpp>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+static const int connectTimeoutMs = 10000;
+//a read that waits longer than this fails the download
+static const int readTimeout = 30;
+static const size_t maxHeaderBytes = 64 * 1024;
+//bytes moved per splice, the pipe is grown to hold them
+static const int pipeBytes = 1024 * 1024;
+
+struct HttpTarget {
+    std::string host;
+    std::string port;
+    //Host header and request target
+    std::string authority;
+    std::string path;
+};
+
+static bool UrlPart(CURLU* h, CURLUPart what, std::string& value, unsigned int flags = 0) {
+    char* part = NULL;
+    if (curl_url_get(h, what, &part, flags) != CURLUE_OK) {
+        return false;
+    }
+    value = part;
+    curl_free(part);
+    return true;
+}
+
+//the parts of a plain http url without credentials, false for anything else
+static bool ParseTarget(std::string url, HttpTarget& target) {
+    CURLU* h = curl_url();
+    if (!h) {
+        return false;
+    }
+    std::string scheme, user, port, query;
+    bool ok = curl_url_set(h, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK &&
+        UrlPart(h, CURLUPART_SCHEME, scheme) && scheme == "http" &&
+        !UrlPart(h, CURLUPART_USER, user) &&
+        UrlPart(h, CURLUPART_HOST, target.host) &&
+        UrlPart(h, CURLUPART_PORT, target.port, CURLU_DEFAULT_PORT) &&
+        UrlPart(h, CURLUPART_PATH, target.path);
+    if (ok) {
+        target.authority = target.host;
+        if (UrlPart(h, CURLUPART_PORT, port)) {
+            target.authority += ":" + port;
+        }
+        if (UrlPart(h, CURLUPART_QUERY, query)) {
+            target.path += "?" + query;
+        }
+        if (target.host.size() > 2 && target.host[0] == '[') {
+            target.host = target.host.substr(1, target.host.size() - 2);
+        }
+    }
+    curl_url_cleanup(h);
+    return ok;
+}
+
+static int Connect(const HttpTarget& target, const std::string& host) {
+    struct addrinfo hints = {};
+    struct addrinfo* res = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(target.host.c_str(), target.port.c_str(), &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            continue;
+        }
+        Network().Apply(fd, host);
+        bool connected = connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS) {
+            struct pollfd p = {fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t length = sizeof(error);
+            connected = poll(&p, 1, connectTimeoutMs) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+        }
+        if (!connected) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        struct timeval timeout = {readTimeout, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+    return fd;
+}
+
+static bool WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static std::string Lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return s;
+}
+
+static std::string Env(const char* lower, const char* upper) {
+    const char* value = getenv(lower);
+    if ((!value || !*value) && upper) {
+        value = getenv(upper);
+    }
+    return value ? value : "";
+}
+
+//true if curl would send the request through a proxy from the environment:
+//http_proxy or all_proxy is set and no_proxy doesn't exempt the host
+static bool Proxied(const HttpTarget& target) {
+    if (Env("http_proxy", "HTTP_PROXY") == "" && Env("all_proxy", "ALL_PROXY") == "") {
+        return false;
+    }
+    std::string host = Lower(target.host);
+    //addresses only match themselves, names every name under them too
+    unsigned char buf[16];
+    bool address = inet_pton(AF_INET, host.c_str(), buf) == 1 || inet_pton(AF_INET6, host.c_str(), buf) == 1;
+    std::string exempt = Env("no_proxy", "NO_PROXY");
+    for (char& c : exempt) {
+        if (c == ' ' || c == '\t') {
+            c = ',';
+        }
+    }
+    size_t start = 0;
+    while (start <= exempt.size()) {
+        size_t end = exempt.find(',', start);
+        if (end == std::string::npos) {
+            end = exempt.size();
+        }
+        std::string entry = Lower(exempt.substr(start, end - start));
+        start = end + 1;
+        if (entry.size() > 2 && entry[0] == '[' && entry.back() == ']') {
+            entry = entry.substr(1, entry.size() - 2);
+        }
+        while (entry != "" && entry[0] == '.') {
+            entry.erase(0, 1);
+        }
+        if (entry == "*") {
+            return false;
+        }
+        if (entry != "" && (host == entry || (!address &&
+            host.size() > entry.size() && host.compare(host.size() - entry.size(), entry.size(), entry) == 0 &&
+            host[host.size() - entry.size() - 1] == '.'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//reads the response head, leaving what came after it in body. Sets the
+//content length (-1 if the body runs to the end of the connection), false
+//unless it is a 200 with an identity body
+static bool ReadHead(int fd, std::string& body, curl_off_t& length) {
+    std::string head;
+    size_t end;
+    char buffer[16 * 1024];
+    while ((end = head.find("\r\n\r\n")) == std::string::npos) {
+        if (head.size() > maxHeaderBytes) {
+            return false;
+        }
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        head.append(buffer, n);
+    }
+    body = head.substr(end + 4);
+    head.resize(end);
+    size_t space = head.find(' ');
+    if (head.compare(0, 7, "HTTP/1.") != 0 || space == std::string::npos || atoi(head.c_str() + space + 1) != 200) {
+        return false;
+    }
+    length = -1;
+    size_t line = head.find("\r\n");
+    while (line != std::string::npos) {
+        size_t next = head.find("\r\n", line + 2);
+        std::string header = head.substr(line + 2, next == std::string::npos ? std::string::npos : next - line - 2);
+        line = next;
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = Lower(header.substr(0, colon));
+        size_t start = header.find_first_not_of(" \t", colon + 1);
+        std::string value = start == std::string::npos ? "" : header.substr(start);
+        if (name == "transfer-encoding" || (name == "content-encoding" && Lower(value) != "identity")) {
+            return false;
+        }
+        if (name == "content-length") {
+            length = strtoll(value.c_str(), NULL, 10);
+        }
+    }
+    return true;
+}
+
+//moves the body from the socket to the file, through the pipe while both
+//ends support it, with plain reads and writes otherwise
+static bool MoveBody(int sock, int file, curl_off_t length, SpliceStats& stats) {
+    int pipes[2];
+    bool piped = pipe2(pipes, O_CLOEXEC) == 0;
+    bool splicing = piped;
+    if (piped) {
+        fcntl(pipes[1], F_SETPIPE_SZ, pipeBytes);
+    }
+    std::vector<char> buffer;
+    bool ok = true;
+    while (ok && (length < 0 || stats.bytes < length)) {
+        size_t want = pipeBytes;
+        if (length >= 0) {
+            want = (size_t)std::min<curl_off_t>(want, length - stats.bytes);
+        }
+        if (splicing) {
+            ssize_t in = splice(sock, NULL, pipes[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (in < 0 && errno == EINTR) {
+                continue;
+            }
+            if (in < 0 && errno == EINVAL) {
+                splicing = false;
+                continue;
+            }
+            if (in <= 0) {
+                ok = in == 0 && length < 0;
+                break;
+            }
+            while (in > 0) {
+                ssize_t out = splice(pipes[0], NULL, file, NULL, in, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (out < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (out < 0 && errno == EINVAL) {
+                    //the file system can't take spliced pages, drain the pipe by hand
+                    buffer.resize(pipeBytes);
+                    out = read(pipes[0], buffer.data(), in);
+                    if (out <= 0 || !WriteAll(file, buffer.data(), out)) {
+                        ok = false;
+                        break;
+                    }
+                    splicing = false;
+                    stats.bytes += out;
+                }
+                else if (out <= 0) {
+                    ok = false;
+                    break;
+                }
+                else {
+                    stats.bytes += out;
+                    stats.spliced += out;
+                }
+                in -= out;
+            }
+            continue;
+        }
+        buffer.resize(pipeBytes);
+        ssize_t n = recv(sock, buffer.data(), want, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = n == 0 && length < 0;
+            break;
+        }
+        ok = WriteAll(file, buffer.data(), n);
+        stats.bytes += n;
+    }
+    if (piped) {
+        close(pipes[0]);
+        close(pipes[1]);
+    }
+    return ok;
+}
+#endif
+
+SpliceResult DownloadSpliced(std::string url, FILE* out, SpliceStats& stats) {
+#ifdef __linux__
+    double start = NowSeconds();
+    HttpTarget target;
+    //a proxy the curl transfer would go through must not be bypassed
+    if (!ParseTarget(url, target) || Proxied(target)) {
+        return SpliceResult::Unsupported;
+    }
+    int sock = Connect(target, HostOf(url));
+    if (sock < 0) {
+        return SpliceResult::Unsupported;
+    }
+    std::string request = "GET " + target.path + " HTTP/1.1\r\nHost: " + target.authority +
+        "\r\nUser-Agent: download\r\nAccept: */*\r\nConnection: close\r\n\r\n";
+    std::string body;
+    curl_off_t length = -1;
+    if (!WriteAll(sock, request.data(), request.size()) || !ReadHead(sock, body, length)) {
+        close(sock);
+        return SpliceResult::Unsupported;
+    }
+    fflush(out);
+    int file = fileno(out);
+    if (length >= 0 && (curl_off_t)body.size() > length) {
+        body.resize((size_t)length);
+    }
+    bool ok = WriteAll(file, body.data(), body.size());
+    stats.bytes = body.size();
+    ok = ok && MoveBody(sock, file, length, stats);
+    close(sock);
+    stats.seconds = NowSeconds() - start;
+    return ok ? SpliceResult::Ok : SpliceResult::Failed;
+#else
+    (void)url;
+    (void)out;
+    (void)stats;
+    return SpliceResult::Unsupported;
+#endif
+}
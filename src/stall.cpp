@@ -0,0 +1,136 @@
+#include <stall.hpp>
+#include <util.hpp>
+#include <vector>
+
+StallDetector::StallDetector(StallOptions _opts) {
+    opts = _opts;
+    stalledTime = 0;
+    Reset(0);
+}
+
+void StallDetector::Reset(double now) {
+    samples.clear();
+    started = now;
+}
+
+bool StallDetector::Update(double now, curl_off_t total) {
+    if (samples.empty() && started == 0) {
+        started = now;
+    }
+    if (!samples.empty()) {
+        double dt = now - samples.back().first;
+        if (dt > 0 && (total - samples.back().second) / dt < opts.minSpeed) {
+            stalledTime += dt;
+        }
+    }
+    samples.push_back(std::make_pair(now, total));
+    while (samples.size() > 1 && samples.front().first < now - opts.window) {
+        samples.pop_front();
+    }
+    //give every connection a full window before judging it
+    if (now - started < opts.window) {
+        return false;
+    }
+    double span = now - samples.front().first;
+    if (span <= 0) {
+        return false;
+    }
+    return (total - samples.front().second) / span < opts.minSpeed;
+}
+
+double StallDetector::StalledTime() {
+    return stalledTime;
+}
+
+int StallXferInfo(void* ptr, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    StallDetector* detector = (StallDetector*)ptr;
+    return detector->Update(NowSeconds(), dlnow) ? 1 : 0;
+}
+
+struct ResumeProgress {
+    StallDetector* detector;
+    curl_off_t offset;
+    MeterFunc meter;
+    bool stalled;
+};
+
+static int ResumeXferInfo(void* ptr, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+    ResumeProgress* p = (ResumeProgress*)ptr;
+    if (p->meter && dltotal > 0) {
+        p->meter(NULL, (double)(p->offset + dltotal), (double)(p->offset + dlnow), 0, 0);
+    }
+    if (p->detector->Update(NowSeconds(), p->offset + dlnow)) {
+        p->stalled = true;
+        return 1;
+    }
+    return 0;
+}
+
+CURLcode PerformWithResume(CURL* curl, FILE*& file, std::string output, std::string url, StallOptions opts, ResumeStats& stats, MeterFunc meter) {
+    StallDetector detector(opts);
+    ResumeProgress progress;
+    progress.detector = &detector;
+    progress.offset = 0;
+    progress.meter = meter;
+
+    //host the addresses were resolved for
+    std::string resolved = "";
+    std::vector<std::string> addresses;
+    struct curl_slist* resolve = NULL;
+
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ResumeXferInfo);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &progress);
+
+    CURLcode result;
+    while (true) {
+        progress.stalled = false;
+        detector.Reset(NowSeconds());
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, progress.offset);
+        result = curl_easy_perform(curl);
+        fflush(file);
+
+        if (result == CURLE_RANGE_ERROR && progress.offset > 0) {
+            //the server ignored the range, start over
+            file = freopen(output.c_str(), "wb", file);
+            if (!file) {
+                break;
+            }
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, file);
+            progress.offset = 0;
+            continue;
+        }
+        //an alternate address that refuses connections just moves on to the next one
+        bool unreachable = result == CURLE_COULDNT_CONNECT && resolve != NULL;
+        if (!(result == CURLE_ABORTED_BY_CALLBACK && progress.stalled) && !unreachable) {
+            break;
+        }
+        if (stats.reconnects >= opts.maxReconnects) {
+            break;
+        }
+
+        //resume from what actually reached the file on a fresh connection
+        stats.reconnects++;
+        progress.offset = TellFile(file);
+        curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+        //after a redirect the stalled connection went to the host of the effective url
+        char* effective = NULL;
+        curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective);
+        std::string target = effective ? effective : url;
+        std::string host = HostOf(target);
+        if (host != resolved) {
+            addresses = host != "" ? ResolveAddresses(host) : std::vector<std::string>();
+            resolved = host;
+        }
+        if (addresses.size() > 1) {
+            std::string entry = host + ":" + std::to_string(PortOf(target)) + ":" + addresses[stats.reconnects % addresses.size()];
+            curl_slist_free_all(resolve);
+            resolve = curl_slist_append(NULL, entry.c_str());
+            curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+        }
+    }
+    stats.stalledTime = detector.StalledTime();
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, NULL);
+    curl_slist_free_all(resolve);
+    return result;
+}
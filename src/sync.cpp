@@ -0,0 +1,225 @@
+#include <sync.hpp>
+#include <sha256.hpp>
+#include <util.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+struct SyncEntry {
+    std::string url = "";
+    std::string path = "";
+    curl_off_t size = -1;
+    std::string sha256 = "";
+    //local time when the file was found matching, kept in the digest cache
+    time_t mtime = -1;
+    bool ok = false;
+};
+
+struct CachedDigest {
+    curl_off_t size = -1;
+    time_t mtime = -1;
+    std::string sha256 = "";
+};
+
+//digests of files verified by earlier runs, by path: a file whose size and
+//time haven't changed since isn't read again
+static const char* cacheName = ".sync-digests";
+
+static bool IsDigest(std::string& hex) {
+    std::transform(hex.begin(), hex.end(), hex.begin(), ::tolower);
+    return hex.size() == 64 && hex.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+static bool LoadManifest(std::string file, std::string dir, std::vector<SyncEntry>& entries) {
+    std::ifstream list(file);
+    if (!list) {
+        return false;
+    }
+    std::unordered_set<std::string> paths;
+    std::string line;
+    while (std::getline(list, line)) {
+        std::istringstream fields(line);
+        SyncEntry e;
+        std::string path;
+        if (!(fields >> e.url) || e.url[0] == '#') {
+            continue;
+        }
+        if (!(fields >> e.size >> e.sha256) || !IsDigest(e.sha256)) {
+            std::cout << "invalid manifest line: " << line << std::endl;
+            continue;
+        }
+        if (!(fields >> path)) {
+            path = FileNameOf(e.url);
+        }
+        if (path == "" || path.find("..") != std::string::npos) {
+            std::cout << "invalid manifest path: " << line << std::endl;
+            continue;
+        }
+        e.path = JoinPath(dir, path);
+        if (paths.insert(e.path).second) {
+            entries.push_back(e);
+        }
+    }
+    return true;
+}
+
+static void LoadCache(std::string file, std::unordered_map<std::string, CachedDigest>& cache) {
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        CachedDigest c;
+        long long mtime;
+        std::string path;
+        if (fields >> c.size >> mtime >> c.sha256 && std::getline(fields >> std::ws, path)) {
+            c.mtime = (time_t)mtime;
+            cache[path] = c;
+        }
+    }
+}
+
+static void WriteCache(std::string file, std::vector<SyncEntry>& entries) {
+    std::string temp = file + ".tmp";
+    FILE* out = fopen(temp.c_str(), "wb");
+    if (!out) {
+        return;
+    }
+    for (SyncEntry& e : entries) {
+        if (e.ok) {
+            fprintf(out, "%lld %lld %s %s\n", (long long)e.size, (long long)e.mtime, e.sha256.c_str(), e.path.c_str());
+        }
+    }
+    fclose(out);
+    remove(file.c_str());
+    rename(temp.c_str(), file.c_str());
+}
+
+//checks size and digest of the local files, spread over the given number of threads
+static void VerifyEntries(std::vector<SyncEntry*>& items, int threads) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < items.size()) {
+            SyncEntry* e = items[i];
+            curl_off_t size;
+            std::string hex;
+            e->ok = StatFile(e->path, size, e->mtime) && size == e->size && Sha256File(e->path, hex) && hex == e->sha256;
+        }
+    };
+    threads = std::min(threads, (int)items.size());
+    std::vector<std::thread> pool;
+    for (int i = 1; i < threads; i++) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread& t : pool) {
+        t.join();
+    }
+}
+
+bool RunSync(SyncOptions opts, SyncStats& stats) {
+    double started = NowSeconds();
+    std::string dir = opts.batch.outputDir;
+    std::vector<SyncEntry> entries;
+    if (!LoadManifest(opts.manifest, dir, entries)) {
+        std::cout << "error while opening manifest " << opts.manifest << std::endl;
+        return false;
+    }
+    stats.entries = entries.size();
+    std::string cachePath = JoinPath(dir, cacheName);
+    std::unordered_map<std::string, CachedDigest> cache;
+    LoadCache(cachePath, cache);
+    int threads = opts.hashThreads > 0 ? opts.hashThreads : std::max(1, (int)std::thread::hardware_concurrency());
+
+    //only files of the right size are worth reading, and only if the cache doesn't vouch for them
+    std::vector<SyncEntry*> toHash;
+    std::vector<SyncEntry*> toFetch;
+    for (SyncEntry& e : entries) {
+        curl_off_t size;
+        if (!StatFile(e.path, size, e.mtime) || size != e.size) {
+            toFetch.push_back(&e);
+            continue;
+        }
+        auto c = cache.find(e.path);
+        if (c != cache.end() && c->second.size == size && c->second.mtime == e.mtime) {
+            e.ok = c->second.sha256 == e.sha256;
+            if (e.ok) {
+                stats.upToDate++;
+            }
+            else {
+                toFetch.push_back(&e);
+            }
+            continue;
+        }
+        toHash.push_back(&e);
+    }
+    VerifyEntries(toHash, threads);
+    stats.hashed = toHash.size();
+    for (SyncEntry* e : toHash) {
+        if (e->ok) {
+            stats.upToDate++;
+        }
+        else {
+            toFetch.push_back(e);
+        }
+    }
+    std::cout << "sync: " << stats.entries << " files, " << stats.upToDate << " up to date (" << stats.hashed << " hashed), "
+        << toFetch.size() << " to download" << std::endl;
+
+    if (!toFetch.empty()) {
+        std::vector<BatchJob> jobs;
+        for (SyncEntry* e : toFetch) {
+            BatchJob job;
+            job.url = e->url;
+            job.output = e->path;
+            job.host = HostOf(e->url);
+            MakeParentDirs(e->path);
+            jobs.push_back(job);
+        }
+        RunJobs(opts.batch, jobs);
+        //a download only counts once its digest matches the manifest
+        VerifyEntries(toFetch, threads);
+        for (SyncEntry* e : toFetch) {
+            if (e->ok) {
+                stats.downloaded++;
+            }
+            else {
+                stats.failed++;
+                std::cout << e->path << ": size or sha256 doesn't match the manifest after download" << std::endl;
+            }
+        }
+    }
+    if (stats.hashed > 0 || !toFetch.empty()) {
+        WriteCache(cachePath, entries);
+    }
+
+    if (opts.deleteStale) {
+        std::unordered_set<std::string> keep;
+        for (SyncEntry& e : entries) {
+            keep.insert(e.path);
+        }
+        keep.insert(cachePath);
+        std::vector<std::string> files;
+        ListFiles(dir, files);
+        for (std::string& f : files) {
+            if (keep.count(f) == 0 && remove(f.c_str()) == 0) {
+                stats.deleted++;
+                if (opts.batch.verbose) {
+                    std::cout << "deleted " << f << std::endl;
+                }
+            }
+        }
+    }
+
+    std::cout << "sync finished: " << stats.upToDate << " up to date, " << stats.downloaded << " downloaded, " << stats.failed
+        << " failed, " << stats.deleted << " deleted in " << NowSeconds() - started << "s" << std::endl;
+    return stats.failed == 0;
+}
@@ -0,0 +1,375 @@
+#include <tlssessions.hpp>
+#include <util.hpp>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+#ifdef __linux__
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <fcntl.h>
+#include <sys/locking.h>
+#include <sys/stat.h>
+#endif
+
+//sessions kept in the file, the ones valid longest win
+static const size_t maxSessions = 1000;
+//a host hands out a couple of tickets per connection, more don't help
+static const size_t maxPerHost = 4;
+
+static std::atomic<long long> resumedHandshakes(0);
+static std::atomic<long long> fullHandshakes(0);
+
+static std::string Hex(const std::string& data) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(data.size() * 2);
+    for (unsigned char c : data) {
+        hex += digits[c >> 4];
+        hex += digits[c & 15];
+    }
+    return hex;
+}
+
+static std::string Unhex(const std::string& hex) {
+    std::string data;
+    data.reserve(hex.size() / 2);
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        data += (char)strtol(hex.substr(i, 2).c_str(), NULL, 16);
+    }
+    return data;
+}
+
+//holds the lock file next to the cache while alive, shared for reading
+class CacheLock {
+private:
+    int fd;
+public:
+    CacheLock(std::string path, bool exclusive) {
+#ifdef __linux__
+        fd = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            flock(fd, exclusive ? LOCK_EX : LOCK_SH);
+        }
+#else
+        //no shared locks here, readers take turns too
+        fd = _open((path + ".lock").c_str(), _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE);
+        if (fd >= 0) {
+            _locking(fd, _LK_LOCK, 1);
+        }
+#endif
+    }
+    ~CacheLock() {
+#ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+#else
+        if (fd >= 0) {
+            _lseek(fd, 0, SEEK_SET);
+            _locking(fd, _LK_UNLCK, 1);
+            _close(fd);
+        }
+#endif
+    }
+};
+
+typedef std::pair<std::string, StoredSession> HostSession;
+
+//the "expires host:port session" lines of the file that are still valid
+static std::vector<HostSession> ReadSessions(std::string path, time_t now) {
+    std::vector<HostSession> sessions;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        long long expires;
+        std::string host;
+        std::string hex;
+        if (fields >> expires >> host >> hex && expires > now) {
+            StoredSession s;
+            s.data = Unhex(hex);
+            s.expires = (time_t)expires;
+            sessions.push_back(HostSession(host, s));
+        }
+    }
+    return sessions;
+}
+
+#ifdef HAVE_OPENSSL
+typedef int (*NewSessionCallback)(SSL*, SSL_SESSION*);
+//curl's own callback, it keeps the sessions for the share
+static std::atomic<NewSessionCallback> curlNewSession(NULL);
+//"host:port" the connection of a context goes to
+static int peerIndex = -1;
+static std::once_flag peerIndexOnce;
+
+static void FreePeer(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+    delete (std::string*)ptr;
+}
+
+static std::string PeerOf(const SSL* ssl) {
+    std::string* peer = (std::string*)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), peerIndex);
+    return peer ? *peer : "";
+}
+
+static void KeepSession(const std::string& peer, SSL_SESSION* session) {
+    int len = i2d_SSL_SESSION(session, NULL);
+    if (peer == "" || len <= 0 || !SSL_SESSION_is_resumable(session)) {
+        return;
+    }
+    std::string data(len, '\0');
+    unsigned char* p = (unsigned char*)&data[0];
+    i2d_SSL_SESSION(session, &p);
+    Sessions().Keep(peer, data, (time_t)(SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session)));
+}
+
+static int NewSession(SSL* ssl, SSL_SESSION* session) {
+    KeepSession(PeerOf(ssl), session);
+    NewSessionCallback next = curlNewSession;
+    return next ? next(ssl, session) : 0;
+}
+
+static void HandshakeInfo(const SSL* ssl, int where, int) {
+    if (where & SSL_CB_HANDSHAKE_START) {
+        //curl has offered a session of this process if it had one, else one of an earlier run goes
+        std::string peer = PeerOf(ssl);
+        std::string data;
+        if (!SSL_get_session(ssl) && peer != "" && Sessions().Take(peer, data)) {
+            const unsigned char* p = (const unsigned char*)data.data();
+            SSL_SESSION* session = d2i_SSL_SESSION(NULL, &p, (long)data.size());
+            if (session) {
+                SSL_set_session((SSL*)ssl, session);
+                SSL_SESSION_free(session);
+            }
+        }
+    }
+    if (where & SSL_CB_HANDSHAKE_DONE) {
+        bool resumed = SSL_session_reused((SSL*)ssl) == 1;
+        (resumed ? resumedHandshakes : fullHandshakes)++;
+        //before TLS 1.3 a resumed session isn't replaced by a new one, it stays good
+        if (resumed && SSL_version(ssl) < TLS1_3_VERSION) {
+            KeepSession(PeerOf(ssl), SSL_get_session(ssl));
+        }
+    }
+}
+
+//curl sets up a context per connection, after connecting and before the handshake
+static CURLcode SetupContext(CURL* curl, void* ptr, void*) {
+    SSL_CTX* ctx = (SSL_CTX*)ptr;
+    std::call_once(peerIndexOnce, []() {
+        peerIndex = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, FreePeer);
+    });
+    char* url = NULL;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+    if (url) {
+        SSL_CTX_set_ex_data(ctx, peerIndex, new std::string(HostOf(url) + ":" + std::to_string(PortOf(url))));
+    }
+    NewSessionCallback current = SSL_CTX_sess_get_new_cb(ctx);
+    if (current && current != NewSession) {
+        curlNewSession = current;
+    }
+    SSL_CTX_set_session_cache_mode(ctx, SSL_CTX_get_session_cache_mode(ctx) | SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, NewSession);
+    SSL_CTX_set_info_callback(ctx, HandshakeInfo);
+    return CURLE_OK;
+}
+#endif
+
+TlsSessions::TlsSessions() : share(NULL), dirty(false), loaded(0), saved(0) {}
+
+TlsSessions::~TlsSessions() {
+    Close();
+}
+
+void TlsSessions::Lock(CURL*, curl_lock_data data, curl_lock_access, void* ptr) {
+    ((TlsSessions*)ptr)->locks[data].lock();
+}
+
+void TlsSessions::Unlock(CURL*, curl_lock_data data, void* ptr) {
+    ((TlsSessions*)ptr)->locks[data].unlock();
+}
+
+bool TlsSessions::Open(std::string path) {
+    if (share) {
+        return true;
+    }
+    share = curl_share_init();
+    if (!share) {
+        return false;
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, Lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, Unlock);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#ifdef HAVE_OPENSSL
+    file = path;
+    if (file != "") {
+        CacheLock lock(file, false);
+        for (HostSession& s : ReadSessions(file, time(NULL))) {
+            stored[s.first].push_back(s.second);
+            imported.insert(s.second.data);
+            loaded++;
+        }
+    }
+    return true;
+#else
+    return path == "";
+#endif
+}
+
+void TlsSessions::Attach(CURL* curl) {
+    if (!share) {
+        return;
+    }
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+#ifdef HAVE_OPENSSL
+    //a tls backend other than OpenSSL ignores it
+    curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, SetupContext);
+#endif
+}
+
+bool TlsSessions::Active() const {
+    return share != NULL;
+}
+
+bool TlsSessions::Take(const std::string& host, std::string& data) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    auto h = stored.find(host);
+    if (h == stored.end()) {
+        return false;
+    }
+    //the ticket valid longest, a session is offered once
+    time_t now = time(NULL);
+    std::vector<StoredSession>& list = h->second;
+    size_t best = list.size();
+    for (size_t i = 0; i < list.size(); i++) {
+        if (list[i].expires > now && (best == list.size() || list[i].expires > list[best].expires)) {
+            best = i;
+        }
+    }
+    if (best == list.size()) {
+        return false;
+    }
+    data = list[best].data;
+    list.erase(list.begin() + best);
+    dirty = true;
+    return true;
+}
+
+void TlsSessions::Keep(const std::string& host, const std::string& data, time_t expires) {
+    std::lock_guard<std::mutex> guard(storeLock);
+    std::vector<StoredSession>& list = stored[host];
+    for (StoredSession& s : list) {
+        if (s.data == data) {
+            return;
+        }
+    }
+    StoredSession s;
+    s.data = data;
+    s.expires = expires;
+    list.push_back(s);
+    if (list.size() > maxPerHost) {
+        list.erase(std::min_element(list.begin(), list.end(), [](const StoredSession& a, const StoredSession& b) {
+            return a.expires < b.expires;
+        }));
+    }
+    dirty = true;
+}
+
+void TlsSessions::Close() {
+    if (!share) {
+        return;
+    }
+    if (file != "" && dirty && MakeParentDirs(file)) {
+        //whatever other processes saved meanwhile is kept
+        CacheLock lock(file, true);
+        time_t now = time(NULL);
+        std::vector<HostSession> onDisk = ReadSessions(file, now);
+        std::lock_guard<std::mutex> guard(storeLock);
+        std::vector<HostSession> sessions;
+        for (auto& h : stored) {
+            for (StoredSession& s : h.second) {
+                sessions.push_back(HostSession(h.first, s));
+                imported.insert(s.data);
+            }
+        }
+        for (HostSession& s : onDisk) {
+            if (!imported.count(s.second.data)) {
+                sessions.push_back(s);
+            }
+        }
+        std::stable_sort(sessions.begin(), sessions.end(), [](const HostSession& a, const HostSession& b) {
+            return a.second.expires > b.second.expires;
+        });
+        std::string temp = file + ".tmp";
+#ifdef __linux__
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        FILE* out = fd >= 0 ? fdopen(fd, "w") : NULL;
+#else
+        FILE* out = fopen(temp.c_str(), "w");
+#endif
+        if (out) {
+            std::map<std::string, size_t> perHost;
+            for (HostSession& s : sessions) {
+                if (s.second.expires <= now || saved >= (long long)maxSessions || ++perHost[s.first] > maxPerHost) {
+                    continue;
+                }
+                fprintf(out, "%lld %s %s\n", (long long)s.second.expires, s.first.c_str(), Hex(s.second.data).c_str());
+                saved++;
+            }
+            bool ok = fclose(out) == 0;
+#ifndef __linux__
+            remove(file.c_str());
+#endif
+            if (!ok || rename(temp.c_str(), file.c_str()) != 0) {
+                remove(temp.c_str());
+                saved = 0;
+            }
+        }
+    }
+    curl_share_cleanup(share);
+    share = NULL;
+}
+
+long long TlsSessions::Loaded() const {
+    return loaded;
+}
+
+long long TlsSessions::Saved() const {
+    return saved;
+}
+
+long long TlsSessions::Resumed() const {
+#ifdef HAVE_OPENSSL
+    return resumedHandshakes;
+#else
+    return -1;
+#endif
+}
+
+long long TlsSessions::Full() const {
+#ifdef HAVE_OPENSSL
+    return fullHandshakes;
+#else
+    return -1;
+#endif
+}
+
+TlsSessions& Sessions() {
+    static TlsSessions sessions;
+    return sessions;
+}
+
+std::string DefaultTlsCache() {
+    return UserCachePath("tls-sessions");
+}
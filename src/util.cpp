@@ -0,0 +1,322 @@
+#include <util.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <utime.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#else
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <direct.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#include <psapi.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+double NowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string HostOf(std::string url) {
+    std::string host = "";
+    CURLU* h = curl_url();
+    if (h) {
+        char* part = NULL;
+        if (curl_url_set(h, CURLUPART_URL, url.c_str(), CURLU_DEFAULT_SCHEME) == CURLUE_OK &&
+            curl_url_get(h, CURLUPART_HOST, &part, 0) == CURLUE_OK) {
+            host = part;
+            curl_free(part);
+        }
+        curl_url_cleanup(h);
+    }
+    return host;
+}
+
+long PortOf(std::string url) {
+    long port = 0;
+    CURLU* h = curl_url();
+    if (h) {
+        char* part = NULL;
+        if (curl_url_set(h, CURLUPART_URL, url.c_str(), CURLU_DEFAULT_SCHEME) == CURLUE_OK &&
+            curl_url_get(h, CURLUPART_PORT, &part, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+            port = atol(part);
+            curl_free(part);
+        }
+        curl_url_cleanup(h);
+    }
+    return port;
+}
+
+std::vector<std::string> ResolveAddresses(std::string host) {
+    std::vector<std::string> addresses;
+    struct addrinfo hints = {};
+    struct addrinfo* res = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), NULL, &hints, &res) != 0) {
+        return addresses;
+    }
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        char buf[INET6_ADDRSTRLEN];
+        void* addr = (ai->ai_family == AF_INET) ? (void*)&((struct sockaddr_in*)ai->ai_addr)->sin_addr : (void*)&((struct sockaddr_in6*)ai->ai_addr)->sin6_addr;
+        if (inet_ntop(ai->ai_family, addr, buf, sizeof(buf))) {
+            std::string a = buf;
+            //curl wants ipv6 addresses in brackets
+            if (ai->ai_family == AF_INET6) {
+                a = "[" + a + "]";
+            }
+            bool seen = false;
+            for (int i = 0; i < addresses.size(); i++) {
+                if (addresses[i] == a) {
+                    seen = true;
+                }
+            }
+            if (!seen) {
+                addresses.push_back(a);
+            }
+        }
+    }
+    freeaddrinfo(res);
+    return addresses;
+}
+
+std::string FileNameOf(std::string url) {
+    //strip query and fragment
+    size_t end = url.find_first_of("?#");
+    if (end != std::string::npos) {
+        url = url.substr(0, end);
+    }
+    size_t scheme = url.find("://");
+    size_t start = (scheme == std::string::npos) ? 0 : scheme + 3;
+    size_t slash = url.find_last_of('/');
+    if (slash == std::string::npos || slash < start || slash + 1 >= url.size()) {
+        return "index.html";
+    }
+    return url.substr(slash + 1);
+}
+
+int SeekFile(FILE* file, curl_off_t offset) {
+#ifdef __linux__
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#else
+    return _fseeki64(file, offset, SEEK_SET);
+#endif
+}
+
+curl_off_t TellFile(FILE* file) {
+#ifdef __linux__
+    return (curl_off_t)ftello(file);
+#else
+    return (curl_off_t)_ftelli64(file);
+#endif
+}
+
+std::string JoinPath(std::string dir, std::string name) {
+    if (dir == "" || dir == ".") {
+        return name;
+    }
+    if (dir[dir.size() - 1] == '/' || dir[dir.size() - 1] == '\\') {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+std::string ResolveUrl(std::string base, std::string ref) {
+    std::string resolved = ref;
+    CURLU* h = curl_url();
+    if (h) {
+        char* part = NULL;
+        if (curl_url_set(h, CURLUPART_URL, base.c_str(), 0) == CURLUE_OK &&
+            curl_url_set(h, CURLUPART_URL, ref.c_str(), 0) == CURLUE_OK &&
+            curl_url_get(h, CURLUPART_URL, &part, 0) == CURLUE_OK) {
+            resolved = part;
+            curl_free(part);
+        }
+        curl_url_cleanup(h);
+    }
+    return resolved;
+}
+
+static size_t TextWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    ((std::string*)ptr)->append(data, size * nmemb);
+    return size * nmemb;
+}
+
+bool FetchText(CURL* curl, std::string url, std::string& text) {
+    text.clear();
+    curl_easy_reset(curl);
+    Sessions().Attach(curl);
+    Network().Apply(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, TextWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &text);
+    long status = 0;
+    CURLcode code = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    return code == CURLE_OK && status < 400;
+}
+
+bool MakeParentDirs(std::string path) {
+    size_t pos = 0;
+    while ((pos = path.find_first_of("/\\", pos + 1)) != std::string::npos) {
+        std::string dir = path.substr(0, pos);
+#ifdef __linux__
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+#else
+        if (_mkdir(dir.c_str()) != 0 && errno != EEXIST) {
+            return false;
+        }
+#endif
+    }
+    return true;
+}
+
+bool StatFile(std::string path, curl_off_t& size, time_t& mtime) {
+#ifdef __linux__
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+#else
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0) {
+        return false;
+    }
+#endif
+    size = (curl_off_t)st.st_size;
+    mtime = (time_t)st.st_mtime;
+    return true;
+}
+
+bool TruncateFile(std::string path, curl_off_t size) {
+#ifdef __linux__
+    return truncate(path.c_str(), (off_t)size) == 0;
+#else
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = _chsize_s(fd, size) == 0;
+    _close(fd);
+    return ok;
+#endif
+}
+
+bool SetFileTime(std::string path, time_t mtime) {
+#ifdef __linux__
+    struct utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    return utime(path.c_str(), &times) == 0;
+#else
+    struct _utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    return _utime(path.c_str(), &times) == 0;
+#endif
+}
+
+void ListFiles(std::string dir, std::vector<std::string>& files) {
+#ifdef __linux__
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d))) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string path = JoinPath(dir, name);
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
+        if (type == DT_DIR) {
+            ListFiles(path, files);
+        }
+        else if (type == DT_REG) {
+            files.push_back(path);
+        }
+    }
+    closedir(d);
+#else
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(JoinPath(dir, "*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        std::string name = data.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string path = JoinPath(dir, name);
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            ListFiles(path, files);
+        }
+        else {
+            files.push_back(path);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#endif
+}
+
+long PeakMemoryKb() {
+#ifdef __linux__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss;
+#else
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return (long)(counters.PeakWorkingSetSize / 1024);
+#endif
+}
+
+std::string UserCachePath(std::string name) {
+#ifdef __linux__
+    const char* cache = getenv("XDG_CACHE_HOME");
+    if (cache && *cache) {
+        return JoinPath(JoinPath(cache, "download"), name);
+    }
+    const char* home = getenv("HOME");
+    if (!home || !*home) {
+        return "";
+    }
+    return JoinPath(JoinPath(JoinPath(home, ".cache"), "download"), name);
+#else
+    const char* local = getenv("LOCALAPPDATA");
+    if (!local || !*local) {
+        return "";
+    }
+    return JoinPath(JoinPath(local, "download"), name);
+#endif
+}
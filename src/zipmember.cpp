@@ -0,0 +1,321 @@
+#include <zipmember.hpp>
+#include <handlepool.hpp>
+#include <tlssessions.hpp>
+#include <nettuning.hpp>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define ZIP_EOCD_SIG 0x06054b50
+#define ZIP64_LOCATOR_SIG 0x07064b50
+#define ZIP64_EOCD_SIG 0x06064b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_LOCAL_SIG 0x04034b50
+//EOCD record plus the longest possible comment
+#define ZIP_TAIL_SIZE (22 + 65535)
+
+static unsigned long long ReadLE(const std::string& buf, size_t pos, int bytes) {
+    unsigned long long v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | (unsigned char)buf[pos + i];
+    }
+    return v;
+}
+
+struct RangeBody {
+    std::string data;
+    curl_off_t total = -1;
+    long status = 0;
+};
+
+static size_t BodyHeader(char* buffer, size_t size, size_t nitems, void* ptr) {
+    RangeBody* b = (RangeBody*)ptr;
+    std::string line(buffer, size * nitems);
+    std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+    if (line.compare(0, 14, "content-range:") == 0) {
+        size_t slash = line.find('/');
+        if (slash != std::string::npos && line[slash + 1] != '*') {
+            b->total = strtoll(line.c_str() + slash + 1, NULL, 10);
+        }
+    }
+    return size * nitems;
+}
+
+static size_t BodyWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    RangeBody* b = (RangeBody*)ptr;
+    b->data.append(data, size * nmemb);
+    return size * nmemb;
+}
+
+//fetches a range ("a-b" or the suffix form "-n") into memory
+static bool FetchRange(CURL* curl, std::string url, std::string range, RangeBody& body, ZipMemberStats& stats) {
+    curl_easy_reset(curl);
+    Sessions().Attach(curl);
+    Network().Apply(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, BodyHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &body);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, BodyWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    CURLcode code = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &body.status);
+    stats.requests++;
+    if (code != CURLE_OK || body.status != 206) {
+        std::cout << "range request " << range << " failed (HTTP " << body.status << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_ZLIB
+struct MemberSink {
+    FILE* out;
+    bool deflated;
+    z_stream zs;
+    unsigned long crc;
+    curl_off_t written;
+    bool error;
+};
+
+static size_t MemberWrite(char* data, size_t size, size_t nmemb, void* ptr) {
+    MemberSink* s = (MemberSink*)ptr;
+    size_t len = size * nmemb;
+    if (!s->deflated) {
+        if (fwrite(data, 1, len, s->out) != len) {
+            s->error = true;
+            return 0;
+        }
+        s->crc = crc32(s->crc, (const Bytef*)data, (uInt)len);
+        s->written += len;
+        return len;
+    }
+    unsigned char buf[64 * 1024];
+    s->zs.next_in = (Bytef*)data;
+    s->zs.avail_in = (uInt)len;
+    while (s->zs.avail_in > 0) {
+        s->zs.next_out = buf;
+        s->zs.avail_out = sizeof(buf);
+        int ret = inflate(&s->zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            s->error = true;
+            return 0;
+        }
+        size_t have = sizeof(buf) - s->zs.avail_out;
+        if (have > 0 && fwrite(buf, 1, have, s->out) != have) {
+            s->error = true;
+            return 0;
+        }
+        s->crc = crc32(s->crc, buf, (uInt)have);
+        s->written += have;
+        if (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && have == 0)) {
+            break;
+        }
+    }
+    return len;
+}
+#endif
+
+bool ExtractZipMember(std::string url, std::string member, FILE* out, ZipMemberStats& stats) {
+#ifndef HAVE_ZLIB
+    std::cout << "--zip-member needs a build with zlib (HAVE_ZLIB)" << std::endl;
+    return false;
+#else
+    CURL* curl = Handles().Acquire();
+    if (!curl) {
+        return false;
+    }
+    bool ok = false;
+    do {
+        //the end of central directory record is somewhere in the archive's tail
+        RangeBody tail;
+        if (!FetchRange(curl, url, "-" + std::to_string(ZIP_TAIL_SIZE), tail, stats)) {
+            break;
+        }
+        stats.metadataBytes += tail.data.size();
+        curl_off_t size = tail.total >= 0 ? tail.total : (curl_off_t)tail.data.size();
+        curl_off_t tailStart = size - (curl_off_t)tail.data.size();
+        stats.archiveSize = size;
+        size_t eocd = std::string::npos;
+        for (long long i = (long long)tail.data.size() - 22; i >= 0; i--) {
+            if (ReadLE(tail.data, (size_t)i, 4) == ZIP_EOCD_SIG) {
+                eocd = (size_t)i;
+                break;
+            }
+        }
+        if (eocd == std::string::npos) {
+            std::cout << "not a zip archive" << std::endl;
+            break;
+        }
+        unsigned long long cdSize = ReadLE(tail.data, eocd + 12, 4);
+        unsigned long long cdOffset = ReadLE(tail.data, eocd + 16, 4);
+        if (cdSize == 0xFFFFFFFF || cdOffset == 0xFFFFFFFF || ReadLE(tail.data, eocd + 10, 2) == 0xFFFF) {
+            //ZIP64: the locator sits right before the EOCD and points at the ZIP64 record
+            if (eocd < 20 || ReadLE(tail.data, eocd - 20, 4) != ZIP64_LOCATOR_SIG) {
+                std::cout << "missing zip64 locator" << std::endl;
+                break;
+            }
+            curl_off_t recordOffset = (curl_off_t)ReadLE(tail.data, eocd - 20 + 8, 8);
+            std::string record;
+            if (recordOffset >= tailStart && recordOffset + 56 <= size) {
+                record = tail.data.substr((size_t)(recordOffset - tailStart), 56);
+            }
+            else {
+                RangeBody r;
+                if (!FetchRange(curl, url, std::to_string(recordOffset) + "-" + std::to_string(recordOffset + 55), r, stats)) {
+                    break;
+                }
+                stats.metadataBytes += r.data.size();
+                record = r.data;
+            }
+            if (record.size() < 56 || ReadLE(record, 0, 4) != ZIP64_EOCD_SIG) {
+                std::cout << "bad zip64 end of central directory" << std::endl;
+                break;
+            }
+            cdSize = ReadLE(record, 40, 8);
+            cdOffset = ReadLE(record, 48, 8);
+        }
+
+        //a corrupt directory, or one of a self-extractor with the offsets
+        //shifted by the stub, points past the end of the archive
+        if (cdSize > (unsigned long long)size || cdOffset > (unsigned long long)size - cdSize) {
+            std::cout << "bad central directory offset" << std::endl;
+            break;
+        }
+        //the central directory is often already part of the tail
+        std::string cd;
+        if (cdSize == 0) {
+            //an empty archive
+        }
+        else if ((curl_off_t)cdOffset >= tailStart && cdOffset - tailStart + cdSize <= tail.data.size()) {
+            cd = tail.data.substr((size_t)(cdOffset - tailStart), (size_t)cdSize);
+        }
+        else {
+            RangeBody r;
+            if (!FetchRange(curl, url, std::to_string(cdOffset) + "-" + std::to_string(cdOffset + cdSize - 1), r, stats)) {
+                break;
+            }
+            stats.metadataBytes += r.data.size();
+            cd = r.data;
+        }
+
+        bool found = false;
+        unsigned long long method = 0, flags = 0, crc = 0, compSize = 0, uncompSize = 0, localOffset = 0;
+        for (size_t p = 0; p + 46 <= cd.size() && ReadLE(cd, p, 4) == ZIP_CENTRAL_SIG;) {
+            size_t nameLen = ReadLE(cd, p + 28, 2);
+            size_t extraLen = ReadLE(cd, p + 30, 2);
+            size_t commentLen = ReadLE(cd, p + 32, 2);
+            if (cd.compare(p + 46, nameLen, member) == 0 && nameLen == member.size()) {
+                flags = ReadLE(cd, p + 8, 2);
+                method = ReadLE(cd, p + 10, 2);
+                crc = ReadLE(cd, p + 16, 4);
+                compSize = ReadLE(cd, p + 20, 4);
+                uncompSize = ReadLE(cd, p + 24, 4);
+                localOffset = ReadLE(cd, p + 42, 4);
+                //the ZIP64 extra field only holds the values that overflowed, in this order.
+                //A truncated directory may end inside it
+                size_t extraEnd = std::min(p + 46 + nameLen + extraLen, cd.size());
+                for (size_t e = p + 46 + nameLen; e + 4 <= extraEnd;) {
+                    size_t id = ReadLE(cd, e, 2);
+                    size_t len = ReadLE(cd, e + 2, 2);
+                    size_t fieldEnd = std::min(e + 4 + len, extraEnd);
+                    if (id == 0x0001) {
+                        size_t v = e + 4;
+                        if (uncompSize == 0xFFFFFFFF && v + 8 <= fieldEnd) {
+                            uncompSize = ReadLE(cd, v, 8);
+                            v += 8;
+                        }
+                        if (compSize == 0xFFFFFFFF && v + 8 <= fieldEnd) {
+                            compSize = ReadLE(cd, v, 8);
+                            v += 8;
+                        }
+                        if (localOffset == 0xFFFFFFFF && v + 8 <= fieldEnd) {
+                            localOffset = ReadLE(cd, v, 8);
+                        }
+                    }
+                    e += 4 + len;
+                }
+                found = true;
+                break;
+            }
+            p += 46 + nameLen + extraLen + commentLen;
+        }
+        if (!found) {
+            std::cout << "member " << member << " not found in archive" << std::endl;
+            break;
+        }
+        if (flags & 1) {
+            std::cout << "encrypted members are not supported" << std::endl;
+            break;
+        }
+        if (method != 0 && method != 8) {
+            std::cout << "unsupported compression method " << method << std::endl;
+            break;
+        }
+        stats.compressedSize = compSize;
+        stats.uncompressedSize = uncompSize;
+
+        //the local header's name and extra lengths can differ from the central ones
+        RangeBody local;
+        if (!FetchRange(curl, url, std::to_string(localOffset) + "-" + std::to_string(localOffset + 29), local, stats)) {
+            break;
+        }
+        stats.metadataBytes += local.data.size();
+        if (local.data.size() < 30 || ReadLE(local.data, 0, 4) != ZIP_LOCAL_SIG) {
+            std::cout << "bad local file header" << std::endl;
+            break;
+        }
+        unsigned long long dataStart = localOffset + 30 + ReadLE(local.data, 26, 2) + ReadLE(local.data, 28, 2);
+
+        MemberSink sink;
+        sink.out = out;
+        sink.deflated = method == 8;
+        sink.crc = crc32(0L, Z_NULL, 0);
+        sink.written = 0;
+        sink.error = false;
+        memset(&sink.zs, 0, sizeof(sink.zs));
+        if (sink.deflated && inflateInit2(&sink.zs, -MAX_WBITS) != Z_OK) {
+            break;
+        }
+        if (compSize > 0) {
+            std::string range = std::to_string(dataStart) + "-" + std::to_string(dataStart + compSize - 1);
+            curl_easy_reset(curl);
+            Sessions().Attach(curl);
+            Network().Apply(curl);
+            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+            curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, MemberWrite);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+            CURLcode code = curl_easy_perform(curl);
+            long status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            stats.requests++;
+            if (code != CURLE_OK || status != 206) {
+                std::cout << "member data request failed" << std::endl;
+            }
+            else if (sink.error || sink.crc != crc || (unsigned long long)sink.written != uncompSize) {
+                std::cout << "member data is corrupt" << std::endl;
+            }
+            else {
+                ok = true;
+            }
+        }
+        else {
+            ok = uncompSize == 0;
+        }
+        if (sink.deflated) {
+            inflateEnd(&sink.zs);
+        }
+    } while (false);
+    Network().Record(curl);
+    Handles().Release(curl);
+    fflush(out);
+    return ok;
+#endif
+}
@@ -0,0 +1,83 @@
+//regression test: a half-open probe that ends in a 404 must settle the
+//breaker, or the jobs parked behind it are never run and the batch hangs
+#include <batch.hpp>
+#include <util.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+
+//answers every request on its own connection: /error with a 500, /missing with a 404, anything else with a 200
+static void Serve(int listener) {
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        std::string request;
+        char buffer[4096];
+        ssize_t n;
+        while (request.find("\r\n\r\n") == std::string::npos && (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            request.append(buffer, n);
+        }
+        std::string path = request.substr(request.find(' ') + 1);
+        path = path.substr(0, path.find(' '));
+        std::string status = path.compare(0, 6, "/error") == 0 ? "500 Internal Server Error" : path == "/missing" ? "404 Not Found" : "200 OK";
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+        close(fd);
+    }
+}
+
+int main() {
+    //a hang is the failure this test is about
+    alarm(60);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0 ||
+        getsockname(listener, (struct sockaddr*)&addr, &length) != 0) {
+        std::cout << "FAIL: can't listen" << std::endl;
+        return 1;
+    }
+    std::thread(Serve, listener).detach();
+
+    char dir[] = "/tmp/batchprobeXXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cout << "FAIL: can't create the output directory" << std::endl;
+        return 1;
+    }
+    std::string base = "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    std::string list = JoinPath(dir, "list");
+    std::ofstream out(list);
+    //five failures trip the breaker, the 404 is the probe, the last job is parked behind it
+    for (int i = 0; i < 5; i++) {
+        out << base << "/error" << i << " error" << i << std::endl;
+    }
+    out << base << "/missing missing" << std::endl;
+    out << base << "/good good" << std::endl;
+    out.close();
+
+    BatchOptions opts;
+    opts.listFile = list;
+    opts.outputDir = JoinPath(dir, "out");
+    opts.jobs = 1;
+    opts.maxRetries = 0;
+    opts.schedule = "fifo";
+    RunBatch(opts);
+
+    curl_off_t size = 0;
+    time_t mtime = 0;
+    bool ok = StatFile(JoinPath(opts.outputDir, "good"), size, mtime) && size == 2;
+    std::cout << (ok ? "PASS" : "FAIL") << ": job parked behind a 404 probe" << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+//regression test: a batch prefetching DNS from a stub nameserver must take
+//only answers that ask its question, send queries with unpredictable ids,
+//and keep an answer no longer than a day whatever TTL it comes with
+#include <batch.hpp>
+#include <util.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <ctime>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+static const char* hostNames[] = { "alpha.test", "beta.test", "gamma.test" };
+//ten days, more than anything should be cached for
+static const uint32_t longTtl = 864000;
+
+static std::mutex lock;
+static std::vector<uint16_t> ids;
+
+static void AnswerHttp(int fd) {
+    std::string request;
+    char buffer[4096];
+    ssize_t n;
+    while (request.find("\r\n\r\n") == std::string::npos && (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        request.append(buffer, n);
+    }
+    std::string body = "resolved\n";
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    close(fd);
+}
+
+static void ServeHttp(int listener) {
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        std::thread(AnswerHttp, fd).detach();
+    }
+}
+
+static std::string Name(const std::string& host) {
+    std::string name;
+    size_t start = 0;
+    while (start < host.size()) {
+        size_t dot = host.find('.', start);
+        if (dot == std::string::npos) {
+            dot = host.size();
+        }
+        name += (char)(dot - start);
+        name.append(host, start, dot - start);
+        start = dot + 1;
+    }
+    return name + '\0';
+}
+
+//a response with the id of the query to the given question, one A record for
+//an A question and none for AAAA
+static std::string Response(const std::string& query, const std::string& question, const char* address) {
+    bool a = question[question.size() - 3] == 1;
+    std::string r = query.substr(0, 2);
+    const unsigned char header[10] = { 0x81, 0x80, 0, 1, 0, (unsigned char)(a ? 1 : 0), 0, 0, 0, 0 };
+    r.append((const char*)header, sizeof(header));
+    r += question;
+    if (a) {
+        const unsigned char record[10] = { 0xc0, 0x0c, 0, 1, 0, 1, (unsigned char)(longTtl >> 24), (unsigned char)(longTtl >> 16), (unsigned char)(longTtl >> 8), (unsigned char)longTtl };
+        r.append((const char*)record, sizeof(record));
+        r += '\0';
+        r += '\4';
+        in_addr addr;
+        inet_pton(AF_INET, address, &addr);
+        r.append((const char*)&addr, 4);
+    }
+    return r;
+}
+
+//every query first gets an answer to another question, as a spoofer racing
+//the nameserver would send it, then the real one
+static void ServeDns(int fd) {
+    unsigned char msg[512];
+    sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    ssize_t len;
+    while ((len = recvfrom(fd, msg, sizeof(msg), 0, (sockaddr*)&from, &fromLen)) > 12) {
+        std::string query((const char*)msg, len);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ids.push_back((uint16_t)((msg[0] << 8) | msg[1]));
+        }
+        std::string question = query.substr(12);
+        std::string spoofed = Name("evil.test") + question.substr(question.size() - 4);
+        std::string fake = Response(query, spoofed, "127.0.0.2");
+        std::string real = Response(query, question, "127.0.0.1");
+        sendto(fd, fake.data(), fake.size(), 0, (sockaddr*)&from, fromLen);
+        sendto(fd, real.data(), real.size(), 0, (sockaddr*)&from, fromLen);
+    }
+}
+
+int main() {
+    alarm(60);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0 ||
+        getsockname(listener, (sockaddr*)&addr, &length) != 0) {
+        std::cout << "FAIL: can't listen" << std::endl;
+        return 1;
+    }
+    std::thread(ServeHttp, listener).detach();
+    int dns = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in dnsAddr = {};
+    dnsAddr.sin_family = AF_INET;
+    dnsAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    length = sizeof(dnsAddr);
+    if (bind(dns, (sockaddr*)&dnsAddr, sizeof(dnsAddr)) != 0 || getsockname(dns, (sockaddr*)&dnsAddr, &length) != 0) {
+        std::cout << "FAIL: can't bind the nameserver" << std::endl;
+        return 1;
+    }
+    std::thread(ServeDns, dns).detach();
+
+    char dir[] = "/tmp/dnsstubXXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cout << "FAIL: can't create the output directory" << std::endl;
+        return 1;
+    }
+    BatchOptions opts;
+    opts.listFile = JoinPath(dir, "list");
+    opts.outputDir = JoinPath(dir, "out");
+    opts.dnsPrefetch = true;
+    opts.dnsCache = JoinPath(dir, "dnscache");
+    opts.dnsServer = "127.0.0.1:" + std::to_string(ntohs(dnsAddr.sin_port));
+    std::ofstream list(opts.listFile);
+    for (const char* host : hostNames) {
+        list << "http://" << host << ":" << ntohs(addr.sin_port) << "/file " << host << std::endl;
+    }
+    list.close();
+    time_t start = time(NULL);
+    RunBatch(opts);
+    time_t end = time(NULL);
+
+    bool ok = true;
+    //the spoofed answers point at 127.0.0.2, where nothing listens
+    for (const char* host : hostNames) {
+        std::ifstream in(JoinPath(opts.outputDir, host));
+        std::string line;
+        if (!std::getline(in, line) || line != "resolved") {
+            std::cout << "FAIL: " << host << " wasn't fetched from the address the nameserver gave" << std::endl;
+            ok = false;
+        }
+    }
+    std::ifstream cache(opts.dnsCache);
+    std::string line;
+    int entries = 0;
+    while (std::getline(cache, line)) {
+        std::istringstream fields(line);
+        std::string host, address;
+        long long expires;
+        fields >> host >> expires >> address;
+        entries++;
+        if (address != "127.0.0.1" || fields >> address) {
+            std::cout << "FAIL: " << host << " cached with the wrong addresses: " << line << std::endl;
+            ok = false;
+        }
+        if (expires < start + 86400 || expires > end + 86400) {
+            std::cout << "FAIL: " << host << " cached for " << expires - start << "s instead of a day" << std::endl;
+            ok = false;
+        }
+    }
+    if (entries != (int)(sizeof(hostNames) / sizeof(hostNames[0]))) {
+        std::cout << "FAIL: " << entries << " hosts in the cache file" << std::endl;
+        ok = false;
+    }
+    //sequential ids would make every step 1
+    int sequential = 0;
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 1; i < ids.size(); i++) {
+        sequential += (uint16_t)(ids[i] - ids[i - 1]) == 1 ? 1 : 0;
+    }
+    if (ids.size() < 2 || sequential == (int)ids.size() - 1) {
+        std::cout << "FAIL: " << ids.size() << " queries with sequential ids" << std::endl;
+        ok = false;
+    }
+    std::cout << (ok ? "PASS" : "FAIL") << ": " << ids.size() << " queries to the stub nameserver, spoofed answers ignored and TTLs capped at a day" << std::endl;
+    return ok ? 0 : 1;
+}
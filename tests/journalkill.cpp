@@ -0,0 +1,192 @@
+//regression test: a journaled batch killed with SIGKILL, its journal then
+//given a garbage tail, must redo only the jobs the journal doesn't have as
+//finished when run again, and end with every output complete
+#include <batch.hpp>
+#include <journal.hpp>
+#include <util.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+
+static const int fileCount = 60;
+
+static std::mutex lock;
+static std::map<std::string, int> requests;
+static std::atomic<int> served(0);
+
+static std::string BodyOf(const std::string& path) {
+    std::string body;
+    while (body.size() < 20000) {
+        body += path + "\n";
+    }
+    return body;
+}
+
+//answers one request, slowly enough for the batch to be killed halfway
+static void Answer(int fd) {
+    std::string request;
+    char buffer[4096];
+    ssize_t n;
+    while (request.find("\r\n\r\n") == std::string::npos && (n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        request.append(buffer, n);
+    }
+    std::string path = request.substr(request.find(' ') + 1);
+    path = path.substr(0, path.find(' '));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        requests[path]++;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    std::string body = BodyOf(path);
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+    close(fd);
+    served++;
+}
+
+static void Serve(int listener) {
+    while (true) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        std::thread(Answer, fd).detach();
+    }
+}
+
+static bool ReadFile(const std::string& path, std::string& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream s;
+    s << in.rdbuf();
+    data = s.str();
+    return true;
+}
+
+int main() {
+    alarm(120);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0 ||
+        getsockname(listener, (struct sockaddr*)&addr, &length) != 0) {
+        std::cout << "FAIL: can't listen" << std::endl;
+        return 1;
+    }
+    std::thread(Serve, listener).detach();
+
+    char dir[] = "/tmp/journalkillXXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cout << "FAIL: can't create the output directory" << std::endl;
+        return 1;
+    }
+    std::string base = "http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+    BatchOptions opts;
+    opts.listFile = JoinPath(dir, "list");
+    opts.outputDir = JoinPath(dir, "out");
+    opts.journal = JoinPath(dir, "journal");
+    opts.jobs = 2;
+    opts.schedule = "fifo";
+    std::ofstream list(opts.listFile);
+    for (int i = 0; i < fileCount; i++) {
+        list << base << "/file" << i << " file" << i << std::endl;
+    }
+    list.close();
+
+    //the first run is killed once about half of the files went out
+    pid_t child = fork();
+    if (child == 0) {
+        RunBatch(opts);
+        _exit(0);
+    }
+    while (served < fileCount / 2) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    kill(child, SIGKILL);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFSIGNALED(status)) {
+        std::cout << "FAIL: the batch finished before it was killed" << std::endl;
+        return 1;
+    }
+
+    //a torn record and junk, as a crash in the middle of a write leaves them
+    FILE* journal = fopen(opts.journal.c_str(), "ab");
+    fwrite("\x13\x37garbage-tail\xff\xfe", 1, 17, journal);
+    fclose(journal);
+
+    //what the journal holds as finished, read from a copy so the rerun opens the original
+    std::string copy = JoinPath(dir, "journal.copy");
+    std::string data;
+    ReadFile(opts.journal, data);
+    std::ofstream(copy, std::ios::binary) << data;
+    std::vector<bool> done(fileCount);
+    int finished = 0;
+    {
+        Journal j;
+        if (!j.Open(copy)) {
+            std::cout << "FAIL: can't open the journal" << std::endl;
+            return 1;
+        }
+        for (int i = 0; i < fileCount; i++) {
+            std::string url = base + "/file" + std::to_string(i);
+            std::string output = JoinPath(opts.outputDir, "file" + std::to_string(i));
+            done[i] = j.IsDone((uint32_t)i, Journal::KeyOf(url.c_str(), output.c_str()));
+            finished += done[i] ? 1 : 0;
+        }
+    }
+    if (finished == 0 || finished == fileCount) {
+        std::cout << "FAIL: " << finished << " jobs journaled as finished, the kill missed the middle of the batch" << std::endl;
+        return 1;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        requests.clear();
+    }
+    RunBatch(opts);
+
+    bool ok = true;
+    for (int i = 0; i < fileCount; i++) {
+        std::string path = "/file" + std::to_string(i);
+        int fetched;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            fetched = requests[path];
+        }
+        if (done[i] && fetched > 0) {
+            std::cout << "FAIL: " << path << " was finished but fetched again" << std::endl;
+            ok = false;
+        }
+        if (!done[i] && fetched == 0) {
+            std::cout << "FAIL: " << path << " was unfinished but not fetched" << std::endl;
+            ok = false;
+        }
+        std::string output;
+        if (!ReadFile(JoinPath(opts.outputDir, "file" + std::to_string(i)), output) || output != BodyOf(path)) {
+            std::cout << "FAIL: output of " << path << " is missing or wrong" << std::endl;
+            ok = false;
+        }
+    }
+    std::cout << (ok ? "PASS" : "FAIL") << ": " << finished << " of " << fileCount << " jobs kept across a kill -9 and a garbage journal tail" << std::endl;
+    return ok ? 0 : 1;
+}